@@ -0,0 +1,65 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+/**
+   Allocation check for the audio path.
+   Compiled with -DFM_ALLOC_CHECK, the global operator
+   new/delete are replaced by counting versions and
+   RT_CHECK(expr) evaluates expr, exiting with an error if
+   it allocated. Add -DFM_ALLOC_WRAP_MALLOC and link with
+   -Wl,--wrap=malloc to count malloc calls as well.
+   Without FM_ALLOC_CHECK, RT_CHECK(expr) is just expr.
+   Include from one translation unit only.
+*/
+#ifdef FM_ALLOC_CHECK
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace alloc {
+  inline std::atomic<std::size_t> count(0);
+
+  template<typename F>
+  decltype(auto) check(F f, const char *what) {
+    std::size_t c = count.load();
+    struct Guard {
+      std::size_t c;
+      const char *what;
+      ~Guard() {
+        std::size_t n = count.load() - c;
+        if(n) {
+          std::fprintf(stderr, "%zu allocation(s) in %s\n", n, what);
+          std::exit(1);
+        }
+      }
+    } guard{c, what};
+    return f();
+  }
+}
+
+void *operator new(std::size_t n) {
+  alloc::count++;
+  if(void *p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+#ifdef FM_ALLOC_WRAP_MALLOC
+extern "C" void *__real_malloc(std::size_t);
+extern "C" void *__wrap_malloc(std::size_t n) {
+  alloc::count++;
+  return __real_malloc(n);
+}
+#endif
+
+#define RT_CHECK(e) \
+  (alloc::check([&]() -> decltype(auto) { return e; }, #e))
+#else
+#define RT_CHECK(e) e
+#endif
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+
+/**
+   Halfband decimator class
+   decimates by 2^k (k = 0..4) with a cascade of
+   polyphase halfband FIR stages. Each stage splits its
+   input into even and odd phases: the odd phase only
+   meets the centre tap and the even phase a short
+   symmetric filter, so each output costs K+1 multiplies
+   over contiguous data, which vectorises across outputs.
+   Each stage is the shortest Kaiser halfband that meets
+   the quality's rejection over the band that would alias
+   into the final passband, so only the last stage needs
+   a sharp transition and long filter.
+*/
+class Decimator {
+public:
+  enum Quality { FAST, MEDIUM, BEST };
+
+private:
+  struct Stage {
+    std::size_t K;         // symmetric tap pairs
+    std::vector<float> g;  // even-phase taps
+    std::vector<float> e;  // even phase, 2K history + block
+    std::vector<float> o;  // odd phase, 2K history + block
+    std::vector<float> y;  // stage output (not for the last)
+  };
+
+  std::vector<Stage> stages;
+  std::vector<float> pre;  // input delay line (see align())
+  std::size_t pd;
+  std::size_t fac;
+  std::size_t vs;
+
+  static double bessel0(double x) {
+    double s = 1, t = 1;
+    for(int k = 1; k < 32; k++) {
+      t *= (x/(2*k))*(x/(2*k));
+      s += t;
+    }
+    return s;
+  }
+
+  // Kaiser-windowed halfband with K tap pairs, DC gain 1
+  static std::vector<double> halfband(std::size_t K, double beta) {
+    std::vector<double> h(K);
+    double c = 2*K - 1, sum = 0;
+    for(std::size_t j = 0; j < K; j++) {
+      double d = 2*j + 1, r = d/c;
+      double w = bessel0(beta*std::sqrt(1 - r*r))/bessel0(beta);
+      h[j] = std::sin(M_PI*d/2)/(M_PI*d)*w;
+      sum += h[j];
+    }
+    for(auto &t : h) t *= .25/sum;
+    return h;
+  }
+
+  // worst stopband gain (dB) from lo to 1/2 cycles/sample
+  static double stopband(const std::vector<double> &h, double lo) {
+    double worst = 0;
+    for(double f = lo; f <= .5; f += 1./4096) {
+      double H = .5;
+      for(std::size_t j = 0; j < h.size(); j++)
+        H += 2*h[j]*std::cos(2*M_PI*f*(2*j+1));
+      worst = std::fmax(worst, std::fabs(H));
+    }
+    return 20*std::log10(worst + 1e-300);
+  }
+
+  // shortest halfband with att dB rejection from lo upwards,
+  // designed once per process
+  static std::vector<float> design(double lo, double att) {
+    static std::mutex mtx;
+    static std::map<std::pair<double,double>,
+                    std::vector<float>> designs;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto &g = designs[{lo, att}];
+    if(g.empty()) g = kaiser(lo, att);
+    return g;
+  }
+
+  static std::vector<float> kaiser(double lo, double att) {
+    double beta = att > 50 ? .1102*(att - 8.7) :
+      .5842*std::pow(att - 21, .4) + .07886*(att - 21);
+    std::vector<double> h;
+    for(std::size_t K = 2; K <= 64; K++) {
+      h = halfband(K, beta);
+      if(stopband(h, lo) <= -att) break;
+    }
+    return std::vector<float>(h.begin(), h.end());
+  }
+
+  static void run(Stage &st, const float *in, float *y,
+                  std::size_t nout) {
+    std::size_t K = st.K, H = 2*K;
+    float *e = st.e.data(), *o = st.o.data();
+    const float *g = st.g.data();
+    for(std::size_t m = 0; m < nout; m++) {
+      e[H+m] = in[2*m];
+      o[H+m] = in[2*m+1];
+    }
+    for(std::size_t m = 0; m < nout; m++) y[m] = .5f*o[H+m-K];
+    for(std::size_t j = 0; j < K; j++) {
+      const float *a = e + H - K - j, *b = e + H - K + j + 1;
+      float gj = g[j];
+      for(std::size_t m = 0; m < nout; m++)
+        y[m] += gj*(a[m] + b[m]);
+    }
+    for(std::size_t i = 0; i < H; i++) {
+      e[i] = e[nout+i];
+      o[i] = o[nout+i];
+    }
+  }
+
+public:
+  /**
+     std::size_t os: decimation factor (rounded down to 2^k, k <= 4)
+     std::size_t vsize: output block size
+     Quality q: stopband rejection and passband width
+  */
+  Decimator(std::size_t os, std::size_t vsize, Quality q = MEDIUM) :
+    pd(0), fac(1), vs(vsize) {
+    // stopband rejection (dB) and passband edge (of fs out)
+    static const double att[] = {60., 90., 120.};
+    static const double pass[] = {.4, .42, .45};
+    std::size_t k = 0;
+    while((fac << 1) <= os && k < 4) {
+      fac <<= 1;
+      k++;
+    }
+    for(std::size_t s = 0; s < k; s++) {
+      // band to keep, in cycles/sample at this stage's input
+      double p = (s == k - 1 ? pass[q] : .5)/(fac >> s);
+      auto g = design(.5 - p, att[q]);
+      std::size_t K = g.size();
+      std::size_t nout = vsize*(fac >> (s+1));
+      stages.push_back({K, g,
+            std::vector<float>(2*K + nout),
+            std::vector<float>(2*K + nout),
+            std::vector<float>(s == k - 1 ? 0 : nout)});
+    }
+  }
+
+  /**
+     returns the decimation factor
+  */
+  std::size_t factor() { return fac; }
+
+  /**
+     returns the group delay in output samples
+  */
+  double delay() const {
+    double d = (double) pd/fac;
+    for(std::size_t s = 0; s < stages.size(); s++)
+      d += (2.*stages[s].K - 1)/(fac >> s);
+    return d;
+  }
+
+  /**
+     std::size_t d: group delay to pad to, in output samples
+     (at least delay()), so that decimators of different
+     factors stay time-aligned
+  */
+  void align(std::size_t d) {
+    pd = 0;
+    double pad = (d - delay())*fac;
+    pd = pad > 0 ? (std::size_t) std::lround(pad) : 0;
+    pre.assign(pd + vs*fac, 0.f);
+  }
+
+  /**
+     const float *in: input, vsize*factor() samples
+     float *out: output, vsize samples
+  */
+  void operator()(const float *in, float *out) { (*this)(in, out, vs); }
+
+  /**
+     const float *in: input, nframes*factor() samples
+     float *out: output, nframes samples
+     std::size_t nframes: output frames, up to vsize
+  */
+  void operator()(const float *in, float *out, std::size_t nframes) {
+    std::size_t len = nframes*fac;
+    if(pd) {
+      std::copy(in, in + len, pre.begin() + pd);
+      in = pre.data();
+    }
+    if(stages.empty())
+      for(std::size_t n = 0; n < nframes; n++) out[n] = in[n];
+    for(std::size_t s = 0; s < stages.size(); s++) {
+      Stage &st = stages[s];
+      float *y = s + 1 < stages.size() ? st.y.data() : out;
+      run(st, in, y, len >> (s+1));
+      in = y;
+    }
+    if(pd) std::copy(pre.begin() + len, pre.begin() + len + pd,
+                     pre.begin());
+  }
+};
+
+#endif
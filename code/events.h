@@ -0,0 +1,107 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+   Parameter change event
+   takes sample type; sets parameter param to value at
+   frame time (absolute, in output frames since the
+   engine started rendering)
+*/
+template<typename S> struct Event {
+  std::uint64_t time;
+  std::uint32_t param;
+  S value;
+};
+
+/**
+   Event queue template class
+   takes event type and capacity (a power of two); a
+   wait-free single-producer single-consumer ring: push()
+   from the control thread (MIDI, OSC, automation),
+   front()/pop() from the render thread. Neither side
+   locks or allocates; a push to a full queue is dropped
+   and counted.
+*/
+template<typename T, std::size_t C = 1024> class Spsc {
+  static_assert(C > 0 && (C & (C - 1)) == 0,
+                "queue capacity must be a power of two");
+  alignas(64) std::atomic<std::size_t> head;  // next to read (consumer)
+  alignas(64) std::atomic<std::size_t> tail;  // next to write (producer)
+  std::atomic<std::size_t> lost;              // dropped pushes
+  std::atomic<std::size_t> high;              // deepest seen
+  alignas(64) std::array<T,C> ring;
+
+public:
+  Spsc() : head(0), tail(0), lost(0), high(0) { };
+
+  /**
+     queues e; returns false (and counts an overflow) if
+     the queue is full. Producer thread only.
+  */
+  bool push(const T &e) {
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t h = head.load(std::memory_order_acquire);
+    if(t - h == C) {
+      lost.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    ring[t & (C - 1)] = e;
+    tail.store(t + 1, std::memory_order_release);
+    if(t + 1 - h > high.load(std::memory_order_relaxed))
+      high.store(t + 1 - h, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+     returns the oldest event, nullptr if none.
+     Consumer thread only.
+  */
+  const T *front() const {
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire)) return nullptr;
+    return &ring[h & (C - 1)];
+  }
+
+  /**
+     releases the event returned by front().
+     Consumer thread only.
+  */
+  void pop() {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  /**
+     returns the events waiting (any thread, approximate):
+     head is read before tail, and both only grow, so the
+     difference cannot wrap; it can overshoot if events
+     move between the reads, hence the clamp
+  */
+  std::size_t depth() const {
+    std::size_t h = head.load(std::memory_order_acquire);
+    std::size_t t = tail.load(std::memory_order_acquire);
+    return t - h < C ? t - h : C;
+  }
+
+  /**
+     returns the pushes dropped on a full queue
+  */
+  std::size_t overflows() const {
+    return lost.load(std::memory_order_relaxed);
+  }
+
+  /**
+     returns the deepest the queue has been
+  */
+  std::size_t peak() const {
+    return high.load(std::memory_order_relaxed);
+  }
+
+  static constexpr std::size_t capacity() { return C; }
+};
+
+#endif
@@ -135,7 +135,8 @@ public:
       unsigned int vsize: signal vector size
   */
   StackedFM(S fs = (S) 44100., unsigned int vsize = 64) :
-    mod0(fs,vsize), mod1(fs,vsize), car(fs,vsize) { };
+    mod0(fs,vsize), mod1(fs,vsize), car(fs,vsize), amp(vsize),
+    add(vsize) { };
 
   /**
      returns signal vector size
@@ -168,22 +169,31 @@ public:
   }
 };
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
 int main(int argc, const char* argv[]) {
   if(argc > 3) {
     double dur = std::atof(argv[1]);
     double amp = std::atof(argv[2]);
     double fr = std::atof(argv[3]);
+    const char *dest = argc>4?argv[4]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
     StackedFM<double> fm;
     for(int n = 0; n < fm.fs()*dur; n += fm.vsize()) {
       const std::vector<double> &out =
-        fm.audio(amp,fr,fr,fr,3,2);
-      for(int i = 0; i < fm.vsize(); i++)
-        std::cout << out[i] << std::endl;
+        RT_CHECK(fm.audio(amp,fr,fr,fr,3,2));
+      write(out);
     }
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz)" << std::endl;
+      " dur(s) amp freq(Hz) [fmt]" << std::endl;
   return 0;
 }
+#endif
@@ -164,27 +164,36 @@ public:
   */
   const std::vector<S> &operator()(S a, S fc, S fm0, S fm1,
                               S z0, S z1) {
-    auto s0 = add(fm1, mod0(z0*fm0,fm0));
-    auto s1 = add(fc, mod1(amp(z1,s0),s0));
+    const auto &s0 = add(fm1, mod0(z0*fm0,fm0));
+    const auto &s1 = add(fc, mod1(amp(z1,s0),s0));
     return car(a,s1);
   }
 };
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
 int main(int argc, const char* argv[]) {
   if(argc > 3) {
     auto dur = std::atof(argv[1]);
     auto amp = std::atof(argv[2]);
     auto fr = std::atof(argv[3]);
+    const char *dest = argc>4?argv[4]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
     StackedFM<double> fm;
     for(int n = 0; n < fm.fs()*dur; n += fm.vsize()) {
-       auto out = fm(amp,fr,fr,fr,3,2);
-       for(auto s : out)
-        std::cout << s << std::endl;
+       auto &out = RT_CHECK(fm(amp,fr,fr,fr,3,2));
+       write(out);
     }
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz)" << std::endl;
+      " dur(s) amp freq(Hz) [fmt]" << std::endl;
   return 0;
 }
+#endif
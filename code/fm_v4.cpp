@@ -1,29 +1,52 @@
 #include <vector>
 #include <cmath>
+#include <type_traits>
 const double twopi = 2*M_PI;
 const std::size_t def_vsize = 64;
 const double def_sr = 44100.; 
 
-template<typename S> class Op {
-  std::vector<S> sig;
-  std::function<S(S,S)> op;
+// element-wise expression f(a,e[n]), evaluated on demand
+template<typename S, typename F, typename E>
+struct Expr {
+  S a;
+  E e;
+  F f;
+  S operator[](std::size_t n) const { return f(a, e[n]); }
+};
+
+// signal vector leaf of an expression
+template<typename S>
+struct Ref {
+  const S *p;
+  S operator[](std::size_t n) const { return p[n]; }
+};
+
+template<typename S>
+Ref<S> leaf(const std::vector<S> &v) { return {v.data()}; }
+
+template<typename S, typename F, typename E>
+const Expr<S,F,E> &leaf(const Expr<S,F,E> &e) { return e; }
+
+/**
+   Arithmetic op template class
+   takes sample type and functor type; returns
+   expressions, so chained ops inline into the loop
+   of the oscillator that consumes them
+*/
+template<typename S, typename F> class Op {
+  F op;
 public:
-  /** 
-      unsigned int vsize: signal vector size
-  */
-  Op(std::function<S(S,S)> f,
-     std::size_t vsize = def_vsize)
-    : op(f), sig(vsize) { };
-  
-  const std::vector<S> &
-  operator()(S a, const std::vector<S> &s) {
-    int n = 0;
-    for(auto &out:sig)
-      out = op(a,s[n++]);
-    return sig;
+  Op(F f) : op(f) { };
+
+  template<typename E>
+  auto operator()(S a, const E &s) const {
+    return Expr<S,F,std::decay_t<decltype(leaf(s))>>{a, leaf(s), op};
   }
 };
 
+const auto mul = [](auto a, auto b) { return a*b; };
+const auto sum = [](auto a, auto b) { return a+b; };
+
 
 // integer indexing oscillator (32bit)
 template<typename S>
@@ -68,9 +91,10 @@ class Osc {
     return out;
   }
 
+  template<typename A, typename F>
   const std::vector<S> &operator() (
-  		const std::vector<S> &amp,
-  		const std::vector<S> &fr) {
+  		const A &amp,
+  		const F &fr) {
     std::size_t n = 0;
     for(auto &s : out) {
       s = process(amp[n], (int) (fr[n]*fac));
@@ -79,8 +103,9 @@ class Osc {
     return out;
   }
 
+  template<typename F>
   const std::vector<S> &operator() (S amp,
-  			const std::vector<S> &fr) {
+  			const F &fr) {
     std::size_t n = 0;
     for(auto &s : out)
       s = process(amp, (int) (fr[n++]*fac));
@@ -97,8 +122,8 @@ template<typename S> class StackedFM {
   Osc<S> mod0; 
   Osc<S> mod1;
   Osc<S> car;
-  Op<S> amp;
-  Op<S> add;
+  Op<S,std::decay_t<decltype(mul)>> amp;
+  Op<S,std::decay_t<decltype(sum)>> add;
   
 public:
   /** 
@@ -108,8 +133,7 @@ public:
   StackedFM(const std::vector<S> &table, S fs = (S) def_sr,
             std::size_t vsize = def_vsize) :
     mod0(table,fs,vsize),mod1(table,fs,vsize), car(table,fs,vsize),
-    amp([](S a, S b)->S{ return a*b; },vsize),
-    add([](S a, S b)->S{ return a+b; },vsize) { };
+    amp(mul),add(sum) { };
 
   /**
      returns signal vector size
@@ -140,8 +164,11 @@ public:
   }
 };
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
 int main(int argc, const char* argv[]) {
   if(argc > 3) {
     double sr =argc>4?std::atof(argv[4]):def_sr;
@@ -153,14 +180,20 @@ int main(int argc, const char* argv[]) {
     std::size_t n = 0;
     for(auto &s : tab)
       s = std::cos((n++) *  twopi/(tab.size()-1));
+    const char *dest = argc>5?argv[5]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
     StackedFM<double> fm(tab,sr);
     for(int n = 0; n < fm.fs()*dur; n += fm.vsize()) {
-      auto out = fm(amp,fr,fr,fr,3,2);
-      for(auto s : out)
-        std::cout << s << std::endl;
+      auto &out = RT_CHECK(fm(amp,fr,fr,fr,3,2));
+      write(out);
     }
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz) [sr]" << std::endl;
+      " dur(s) amp freq(Hz) [sr] [fmt]" << std::endl;
   return 0;
 }
+#endif
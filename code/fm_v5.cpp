@@ -116,8 +116,11 @@ public:
   }
 };
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
 int main(int argc, const char* argv[]) {
   if(argc > 3) {
     double sr =argc>4?std::atof(argv[4]):def_sr;
@@ -129,14 +132,20 @@ int main(int argc, const char* argv[]) {
     std::size_t n = 0;
     for(auto &s : tab)
       s = std::cos((n++) *  twopi/(tab.size()-1));
+    const char *dest = argc>5?argv[5]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
     StackedFM<double> fm(tab,sr);
     for(int n = 0; n < fm.fs()*dur; n += fm.vsize()) {
-      auto out = fm(amp,fr,fr,fr,3,2);
-      for(auto s : out)
-        std::cout << s << std::endl;
+      auto &out = RT_CHECK(fm(amp,fr,fr,fr,3,2));
+      write(out);
     }
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz) [sr]" << std::endl;
+      " dur(s) amp freq(Hz) [sr] [fmt]" << std::endl;
   return 0;
 }
+#endif
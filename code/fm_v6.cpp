@@ -123,8 +123,12 @@ public:
   }
 };
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
+#include "sfwriter.h"
 #include <samplerate.h>
 
 int main(int argc, const char* argv[]) {
@@ -144,6 +148,7 @@ int main(int argc, const char* argv[]) {
 
     for(auto &s : tab)
       s = std::cos(twopi/(tab.size()-1)*n++);
+    const char *dest = argc>6?argv[6]:"txt";
     StackedFM<float> fm(tab,sr*ovs,def_vsize*ovs);
 
     cvt.src_ratio = 1./ovs;
@@ -152,18 +157,37 @@ int main(int argc, const char* argv[]) {
     cvt.data_out = out.data();
     cvt.data_in = fm.data();
 
-    for(std::size_t n = 0; n < fm.fs()*dur;
-        n += fm.vsize()) {
-      fm(amp,fr,fr,fr,3,2);
-      src_process(stat, &cvt);
-      for(auto s : out)
-        std::cout << s << std::endl;
+    auto render = [&](auto &write) {
+      for(std::size_t n = 0; n < fm.fs()*dur;
+          n += fm.vsize()) {
+        RT_CHECK(fm(amp,fr,fr,fr,3,2));
+        src_process(stat, &cvt);
+        write(out);
+      }
+    };
+    bool fail = false;
+    if(SndWriter::format(dest)) {
+      SndWriter write(dest,sr);
+      if(write.ok()) render(write);
+      if(!write.flush()) {
+        std::cerr << write.error() << std::endl;
+        fail = true;
+      }
+    } else {
+      Output write(Output::format(dest));
+      if(write.ok()) render(write);
+      else {
+        std::cerr << "unknown output format " << dest << std::endl;
+        fail = true;
+      }
     }
     src_delete (stat) ;
+    if(fail) return 1;
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz) [sr] [ovs]" << std::endl;
+      " dur(s) amp freq(Hz) [sr] [ovs] [fmt|file.wav|file.flac]" << std::endl;
 
 
   return 0;
 }
+#endif
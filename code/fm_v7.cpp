@@ -1,142 +1,752 @@
 #include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <cstdlib>
-#include <samplerate.h>
+#include <cstring>
+#include "output.h"
+#include "alloccount.h"
+#include "sfwriter.h"
+#include "op.h"
+#include "decimator.h"
+#include "offsets.h"
+#include "param.h"
+#include "events.h"
+#include "tune.h"
 const double twopi = 2*M_PI;
 const std::size_t def_vsize = 64;
 const unsigned int def_sr = 44100; 
 
-// integer indexing oscillator (32bit)
-template<typename S>
-class Op {
-  static constexpr long maxlen = 0x100000000; 
-  const std::vector<double> &tab;  
-  std::vector<S> out;
-  std::vector<S> mod;
-  S fdb;
-  unsigned int fs;  
-  unsigned int phs;
-  unsigned int lobits;
-  unsigned int fac;
-  unsigned int lomask;
-  double nfac;
-  
-  double lookup(S f){
-    unsigned int ndx = phs >> lobits; 
-    auto s = tab[ndx] +
-      nfac*(phs & lomask)*(tab[ndx+1] - tab[ndx]); 
-    phs += (int)(f*fac); 
-    return s;
-  }
-
-  const std::vector<S> &process(S a,S fr,
-                                const S* fm,S g){
+/**
+   Stacked FM template class
+   takes sample type, number of modulators N
+   (N = 2 is the zero-level/first-level stack of the
+   paper) and the operators' wave evaluation policy
+   (sine.h). mods[0] is the zero-level modulator and
+   mods[N-1] modulates the carrier; the chain is
+   unrolled at compile time.
+   In adaptive mode (see adaptive()) the oversampling
+   factor is chosen per block from the predicted
+   bandwidth, up to the constructor's factor.
+   process() also takes audio-rate spans and ramps
+   (param.h) for any parameter group; the kernel is
+   specialised on which groups are static.
+*/
+template<typename S = float, std::size_t N = 2, typename W = Linear>
+class StackedFM {
+  static_assert(N > 0, "StackedFM needs at least one modulator");
+  unsigned int rate;
+  std::size_t ovs;
+  std::array<Op<S,W>,N> mods;
+  Op<S,W> car;
+  std::vector<float> buf;
+  std::vector<float> out;
+  std::vector<S> sa, sc;             // a, fc expanded (audio rate)
+  std::array<std::vector<S>,N> sf, sz;  // fm, z expanded
+  Decimator dec;
+  Decimator::Quality qual;
+
+  // adaptive mode
+  bool adapt;
+  double tol;                   // carrier phase error (rad)
+  std::vector<double> tail;     // sidebands over -db, beta = 0, .5 .. 64
+  std::vector<Decimator> decs;  // one per factor 2^j, time-aligned
+  std::vector<float> alt;       // new-factor output during a switch
+  std::size_t cur, nxt;         // current and next factor
+  std::size_t fade;             // frames left before the switch
+  std::size_t warm;             // frames to refill a decimator
+  std::size_t low;              // frames a smaller factor has sufficed
+  static const std::size_t hold = 16;  // blocks
+
+  // note-start modulator phases (see offsets())
+  std::shared_ptr<const Offsets> seed;
+
+  // event-driven parameters (see set(), process() with a
+  // queue): a, fc, fm[0..N-1], z[0..N-1]
+  std::array<S,2*N+2> ctl;
+  std::uint64_t now;            // frames rendered
+  std::size_t stale;            // events applied late
+
+  // oversampling factors are powers of two, up to 16
+  static std::size_t pow2(std::size_t os) {
+    std::size_t p = 1;
+    while(p*2 <= os && p < 16) p *= 2;
+    return p;
+  }
+
+  template<std::size_t... I>
+  static std::array<Op<S,W>,N> make(unsigned int sr, std::size_t vs,
+                                  std::shared_ptr<const Table<S>> t,
+                                  std::index_sequence<I...>) {
+    return {{((void) I, Op<S,W>(sr,vs,t))...}};
+  }
+
+  // A, C: S or const S*; F, Z: arrays of either, so
+  // static groups compile to the scalar kernel
+  template<typename A,typename C,typename F,typename Z,
+           std::size_t... I>
+  void fused(A a,C fc,const F &fm,const Z &z,std::size_t len,
+             std::index_sequence<I...>) {
+    unsigned int p[N], pc;
+    S b[N], bc, m, mc;
+    ((mods[I].load(p[I],b[I])), ...);
+    car.load(pc,bc);
     std::size_t n = 0;
-    for(auto &o : out) {
-      auto f = fr+fdb*g+(fm?fm[n]:0);
-      auto s = lookup(f);
-      mod[n++] = (S) ((fdb = s*f)*a);
-      o = (S) (a*s);
+#if defined(__AVX2__)
+    if constexpr (std::is_same<A,S>::value && std::is_same<C,S>::value &&
+                  std::is_same<F,std::array<S,N>>::value &&
+                  std::is_same<Z,std::array<S,N>>::value)
+      n = lanes(a,fc,fm,z,len,p,b,pc,bc,std::index_sequence<I...>());
+#endif
+    for(; n < len; n++) {
+      m = 0;
+      ((mods[I].step(at(z[I],n),Op<S,W>::freq(at(fm[I],n),b[I],0,m),
+                     p[I],b[I],m)), ...);
+      buf[n] = (float) car.step(at(a,n),Op<S,W>::freq(at(fc,n),bc,0,m),
+                                pc,bc,mc);
     }
-    return out;
+    ((mods[I].store(p[I],b[I])), ...);
+    car.store(pc,bc);
+  }
+
+  // renders n <= vsize frames at factor k <= ovs: the
+  // operators run at sr*ovs, so scaling every frequency by
+  // ovs/k runs the same phase state at sr*k (the
+  // modulation signals scale with it, as they are
+  // proportional to frequency)
+  template<typename A,typename C,typename F,typename Z>
+  void render(std::size_t k,Decimator &d,float *dst,std::size_t n,
+              const A &a,const C &fc,const std::array<F,N> &fm,
+              const std::array<Z,N> &z){
+    S r = (S) (ovs/k);
+    auto ka = expand(a,(S) 1,sa.data(),n,k);
+    auto kc = expand(fc,r,sc.data(),n,k);
+    auto kf = group(fm,r,sf,n,k);
+    auto kz = group(z,(S) 1,sz,n,k);
+    fused(ka,kc,kf,kz,n*k,std::make_index_sequence<N>());
+    d(buf.data(),dst,n);
+  }
+
+#if defined(__AVX2__)
+  // static parameters: the fused chain 8 (float) or 4
+  // (double) frames at a time, each operator's phases
+  // prefix-summed in registers (Op::lanes()) and its
+  // modulation passed on in a register; same arithmetic
+  // as the scalar loop, sample for sample. Takes and
+  // returns the operator states, returns the frames done
+  template<std::size_t... I>
+  std::size_t lanes(S a,S fc,const std::array<S,N> &fm,
+                    const std::array<S,N> &z,std::size_t len,
+                    unsigned int *p,S *b,unsigned int &pc,S &bc,
+                    std::index_sequence<I...>){
+    std::size_t n = 0;
+    if constexpr (std::is_same<S,float>::value) {
+      const __m256i last = _mm256_set1_epi32(7);
+      const __m256 va = _mm256_set1_ps(a), vc = _mm256_set1_ps(fc);
+      __m256i ph[N+1];
+      __m256 fb[N+1];
+      for(std::size_t i = 0; i < N; i++) ph[i] = _mm256_set1_epi32((int) p[i]);
+      ph[N] = _mm256_set1_epi32((int) pc);
+      for(; n + 8 <= len; n += 8) {
+        __m256 m = _mm256_setzero_ps(), f;
+        ((f = _mm256_add_ps(_mm256_set1_ps(fm[I]),m),
+          fb[I] = _mm256_mul_ps(mods[I].lanes(f,ph[I]),f),
+          m = _mm256_mul_ps(fb[I],_mm256_set1_ps(z[I]))), ...);
+        f = _mm256_add_ps(vc,m);
+        __m256 w = car.lanes(f,ph[N]);
+        fb[N] = _mm256_mul_ps(w,f);
+        _mm256_storeu_ps(buf.data() + n,_mm256_mul_ps(va,w));
+      }
+      if(n) {
+        for(std::size_t i = 0; i < N; i++) {
+          p[i] = (unsigned int) _mm256_cvtsi256_si32(ph[i]);
+          b[i] = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(fb[i],last));
+        }
+        pc = (unsigned int) _mm256_cvtsi256_si32(ph[N]);
+        bc = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(fb[N],last));
+      }
+    } else {
+      const __m256d va = _mm256_set1_pd(a), vc = _mm256_set1_pd(fc);
+      __m128i ph[N+1];
+      __m256d fb[N+1];
+      for(std::size_t i = 0; i < N; i++) ph[i] = _mm_set1_epi32((int) p[i]);
+      ph[N] = _mm_set1_epi32((int) pc);
+      for(; n + 4 <= len; n += 4) {
+        __m256d m = _mm256_setzero_pd(), f;
+        ((f = _mm256_add_pd(_mm256_set1_pd(fm[I]),m),
+          fb[I] = _mm256_mul_pd(mods[I].lanes(f,ph[I]),f),
+          m = _mm256_mul_pd(fb[I],_mm256_set1_pd(z[I]))), ...);
+        f = _mm256_add_pd(vc,m);
+        __m256d w = car.lanes(f,ph[N]);
+        fb[N] = _mm256_mul_pd(w,f);
+        _mm_storeu_ps(buf.data() + n,_mm256_cvtpd_ps(_mm256_mul_pd(va,w)));
+      }
+      if(n) {
+        for(std::size_t i = 0; i < N; i++) {
+          p[i] = (unsigned int) _mm_cvtsi128_si32(ph[i]);
+          b[i] = _mm256_cvtsd_f64(_mm256_permute4x64_pd(fb[i],0xff));
+        }
+        pc = (unsigned int) _mm_cvtsi128_si32(ph[N]);
+        bc = _mm256_cvtsd_f64(_mm256_permute4x64_pd(fb[N],0xff));
+      }
+    }
+    return n;
+  }
+#endif
+
+  // expands each input of a group (see expand())
+  template<typename T>
+  static auto group(const std::array<T,N> &x,S g,
+                    std::array<std::vector<S>,N> &bufs,
+                    std::size_t n,std::size_t k) {
+    std::array<decltype(expand(x[0],g,(S *) nullptr,n,k)),N> y;
+    for(std::size_t i = 0; i < N; i++)
+      y[i] = expand(x[i],g,bufs[i].data(),n,k);
+    return y;
+  }
+
+  // renders n <= vsize frames into dst; parameters are
+  // static values, spans of n frames or ramps over them
+  template<typename A,typename C,typename F,typename Z>
+  void block(float *dst,std::size_t n,const A &a,const C &fc,
+             const std::array<F,N> &fm,const std::array<Z,N> &z){
+    if(!adapt) {
+      render(ovs,dec,dst,n,a,fc,fm,z);
+      return;
+    }
+    if(!fade) {
+      std::array<S,N> pf, pz;
+      for(std::size_t i = 0; i < N; i++) {
+        pf[i] = peak(fm[i],n);
+        pz[i] = peak(z[i],n);
+      }
+      std::size_t k = need(peak(fc,n),pf,pz);
+      low = k < cur ? low + n : 0;
+      if(k > cur || (k < cur && low >= hold*out.size())) {
+        nxt = k;
+        fade = warm;
+        low = 0;
+      }
+    }
+    if(fade) {
+      // run both factors from the same operator state, the
+      // new one ahead to refill its decimator, then crossfade
+      // over the last frames
+      unsigned int p[N+1];
+      S b[N+1];
+      for(std::size_t i = 0; i < N; i++) mods[i].load(p[i],b[i]);
+      car.load(p[N],b[N]);
+      render(cur,decs[log2(cur)],dst,n,a,fc,fm,z);
+      for(std::size_t i = 0; i < N; i++) mods[i].store(p[i],b[i]);
+      car.store(p[N],b[N]);
+      render(nxt,decs[log2(nxt)],alt.data(),n,a,fc,fm,z);
+      if(fade <= n) {
+        float g = 1.f/n;
+        for(std::size_t j = 0; j < n; j++)
+          dst[j] += (alt[j] - dst[j])*g*(j+1);
+        cur = nxt;
+        fade = 0;
+      } else fade -= n;
+    } else render(cur,decs[log2(cur)],dst,n,a,fc,fm,z);
+  }
+
+  // significant sidebands for modulation index beta: the
+  // last order with |J_n(beta)| over the rejection
+  // threshold (table, cube-root growth past it)
+  double sidebands(double beta) const {
+    double x = beta*2;
+    if(x < tail.size() - 1) {
+      std::size_t i = (std::size_t) x;
+      return tail[i] + (x - i)*(tail[i+1] - tail[i]);
+    }
+    return beta + (tail.back() - 64)*std::cbrt(beta/64);
+  }
+
+  // smallest factor keeping aliases out of the passband
+  // and the integration drift under threshold. Peak
+  // deviation d and bandwidth h are propagated down the
+  // stack (each modulator signal is its instantaneous
+  // frequency times the index times the wave) to get
+  // the carrier bandwidth B, which must fold to
+  // k*sr - B >= sr/2. Each phase sum lags its modulation
+  // by half a sample (pi*d/(k*sr) rad), and a stage of
+  // index z amplifies the error it receives by about
+  // 1 + 4*pi*z; the carrier's sum e/(k*sr) must stay
+  // under tol
+  std::size_t need(S fc,const std::array<S,N> &fm,
+                   const std::array<S,N> &z) const {
+    double d = 0, h = 0, e = 0;
+    for(std::size_t i = 0; i < N; i++) {
+      double f = std::fabs(fm[i]), zi = std::fabs(z[i]);
+      double w = h > 0 ? sidebands(d/h)*h : 0;
+      d = zi*(f + d);
+      h = f + w + h;
+      e = (1 + 4*M_PI*zi)*e + M_PI*d;
+    }
+    double w = h > 0 ? sidebands(d/h)*h : 0;
+    double k = std::max((std::fabs(fc) + w)/rate + .5,
+                        e/(rate*tol));
+    std::size_t p = 1;
+    while(p < k && p < ovs) p *= 2;
+    return p;
+  }
+
+  static std::size_t log2(std::size_t k) {
+    std::size_t j = 0;
+    while(k >>= 1) j++;
+    return j;
   }
 
 public:
-  Op(const std::vector<double> &table, unsigned int sr, 
-     std::size_t vsize) :
-    tab(table),out(vsize),mod(vsize),fdb(0),fs(sr),
-    phs(0),lobits(0),fac(maxlen/sr){
-    for(unsigned long t = tab.size()-1; 
-        (t & maxlen) == 0; t <<= 1) lobits += 1;
-    lomask = (1 << lobits) - 1;
-    nfac = 1./(lomask + 1);
+  using sample = S;
+
+  /**
+     unsigned int fs: sampling rate
+     std::size_t os: oversampling (rounded down to 2^k <= 16)
+     std::size_t vsize: signal vector size
+     Decimator::Quality q: decimation filter quality
+     table: wave table shared by the operators
+  */
+  StackedFM(unsigned int fs,std::size_t os,
+            std::size_t vsize = def_vsize,
+            Decimator::Quality q = Decimator::MEDIUM,
+            std::shared_ptr<const Table<S>> table =
+            ::table<S>()) :
+    rate(fs),ovs(pow2(os)),
+    mods(make(fs*ovs,vsize*ovs,table,std::make_index_sequence<N>())),
+    car(fs*ovs,vsize*ovs,table),
+    buf(vsize*ovs),out(vsize),sa(vsize*ovs),sc(vsize*ovs),
+    dec(ovs,vsize,q),qual(q),adapt(false),tol(0),cur(ovs),nxt(ovs),
+    fade(0),warm(0),low(0),ctl(),now(0),stale(0){
+    for(auto &v : sf) v.resize(vsize*ovs);
+    for(auto &v : sz) v.resize(vsize*ovs);
+  };
+
+  /**
+     enables adaptive oversampling: each block runs at the
+     smallest power-of-two factor (up to the constructor's)
+     that keeps aliasing and integration drift (carrier
+     phase error against continuous time) under
+     threshold. Factor changes are crossfaded over one
+     block, after the new decimator has been refilled.
+     double db: alias rejection (dB)
+     double drift: drift error level (dB below the signal)
+  */
+  void adaptive(double db = 90, double drift = 40) {
+    double eps = std::pow(10., -db/20);
+    tail.resize(129);
+    for(std::size_t i = 0; i < tail.size(); i++) {
+      double beta = i*.5;
+      std::size_t n = (std::size_t) beta + 64;
+      while(n > 0 &&
+            std::fabs(std::cyl_bessel_j((double) n, beta)) < eps) n--;
+      tail[i] = n;
+    }
+    decs.clear();
+    double d = 0;
+    for(std::size_t k = 1; k <= ovs; k *= 2) {
+      decs.emplace_back(k,out.size(),qual);
+      d = std::max(d,decs.back().delay());
+    }
+    for(auto &dc : decs) dc.align((std::size_t) std::ceil(d));
+    warm = out.size()*
+      (1 + ((std::size_t) (2*std::ceil(d)) + out.size() - 1)/out.size());
+    alt.resize(out.size());
+    tol = std::pow(10., -drift/20);
+    adapt = true;
+    cur = nxt = ovs;
+    fade = low = 0;
+  }
+
+  /**
+     sets the phase offset table used by start() to seed
+     the zero-level modulator (see mkoffsets.cpp), nullptr
+     to start every operator at phase 0
+  */
+  void offsets(std::shared_ptr<const Offsets> t){seed = t;}
+
+  /**
+     starts a note: resets the operators, seeding the
+     zero-level modulator phase from the offset table
+     (if set) so that, for integer fm1/fm0, the stack
+     does not make the carrier drift at low oversampling
+     const std::array<S,N> &fm: modulator frequencies
+     const std::array<S,N> &z: modulation indices
+  */
+  void start(const std::array<S,N> &fm, const std::array<S,N> &z){
+    for(auto &m : mods) m.reset();
+    car.reset();
+    if constexpr (N > 1)
+      if(seed && fm[0] != 0)
+        mods[0].reset((*seed)(z[0],z[1],fm[0]/(fs()*factor()),
+                                 fm[1]/fm[0]));
   }
 
+  /**
+     returns the current oversampling factor
+  */
+  std::size_t factor(){return adapt ? cur : ovs;}
+
+  /**
+     returns the output delay (decimation filter) in samples
+  */
+  double delay(){return adapt ? decs[0].delay() : dec.delay();}
+
   unsigned int vsize(){return out.size();}
-  unsigned int sr(){return fs;}
-  const S *data(){return out.data();}
-  
-  const std::vector<S> &operator()(){return mod;}
-  const std::vector<S> &operator()(S a,S fr,S g=0){
-    return process(a,fr,nullptr,g);
-  }
-  const std::vector<S> &operator()(S a, S fr,
-                                   const std::vector<S> &fm,
-                                   S g = 0) {
-    return process(a,fr,fm.data(),g);
+  unsigned int fs(){return car.sr()/ovs;}
+  static constexpr std::size_t order(){return N;}
+  const float *data() {return out.data();}
+
+  /**
+     audio synthesis method (fused kernel)
+     runs mods[0] -> ... -> mods[N-1] -> car per sample,
+     keeping each operator's state in locals and writing
+     only the carrier output
+     S a: signal amplitude
+     S fc: carrier freq
+     fm: modulator freqs, zero-level first
+     z: modulation indices, zero-level first
+  */
+  const std::vector<float> &operator()(S a,S fc,
+                                       const std::array<S,N> &fm,
+                                       const std::array<S,N> &z){
+    block(out.data(),out.size(),a,fc,fm,z);
+    return out;
+  }
+
+  /**
+     audio synthesis into a caller buffer
+     renders any number of frames straight into dst, in
+     chunks of up to vsize; parameters as operator()
+     float *dst: output, nframes samples
+     std::size_t nframes: frames to render
+  */
+  void process(float *dst,std::size_t nframes,S a,S fc,
+               const std::array<S,N> &fm,const std::array<S,N> &z){
+    for(std::size_t n = 0; n < nframes; n += out.size())
+      block(dst + n,std::min(out.size(),nframes - n),a,fc,fm,z);
+  }
+
+  /**
+     audio synthesis into a caller buffer, with audio-rate
+     parameters: each of a, fc, fm and z (as a group) is
+     a static S, a span const S* of nframes values, or a
+     Ramp<S> (line(), expon()) over the nframes. The kernel
+     is instantiated for the combination, so static
+     groups cost the same as in the scalar form; a group
+     mixing static and moving members takes ramps or
+     spans for all.
+  */
+  template<typename A,typename C,typename F,typename Z>
+  void process(float *dst,std::size_t nframes,const A &a,const C &fc,
+               const std::array<F,N> &fm,const std::array<Z,N> &z){
+    for(std::size_t n = 0; n < nframes; n += out.size()) {
+      std::size_t len = std::min(out.size(),nframes - n);
+      std::array<decltype(slice(fm[0],0,0,1)),N> f;
+      std::array<decltype(slice(z[0],0,0,1)),N> y;
+      for(std::size_t i = 0; i < N; i++) {
+        f[i] = slice(fm[i],n,len,nframes);
+        y[i] = slice(z[i],n,len,nframes);
+      }
+      block(dst + n,len,slice(a,n,len,nframes),slice(fc,n,len,nframes),
+            f,y);
+    }
+  }
+
+  // parameter numbers for set() and Event::param
+  static constexpr std::uint32_t amp = 0, carrier = 1;
+  static constexpr std::uint32_t freq(std::size_t i){return 2 + i;}
+  static constexpr std::uint32_t index(std::size_t i){return 2 + N + i;}
+
+  /**
+     sets an event-driven parameter (before rendering, or
+     from the render thread)
+     std::uint32_t p: parameter number (amp, carrier,
+     freq(i), index(i))
+     S v: value
+  */
+  void set(std::uint32_t p,S v){if(p < ctl.size()) ctl[p] = v;}
+
+  /**
+     returns the events applied after their time
+  */
+  std::size_t late(){return stale;}
+
+  /**
+     audio synthesis driven by an event queue
+     renders nframes into dst, applying each queued event
+     at its frame (splitting the render there); events
+     due before this call are applied at its start and
+     counted by late(). Never locks or allocates.
+     float *dst: output, nframes samples
+     Spsc<Event<S>,C> &q: events from the control thread,
+     in time order
+  */
+  template<std::size_t C>
+  void process(float *dst,std::size_t nframes,Spsc<Event<S>,C> &q){
+    std::size_t n = 0;
+    do {
+      std::size_t end = nframes;
+      for(const Event<S> *e; (e = q.front()); q.pop()) {
+        if(e->time > now + n) {
+          end = (std::size_t) std::min<std::uint64_t>(nframes,
+                                                      e->time - now);
+          break;
+        }
+        if(e->time < now + n) stale++;
+        set(e->param,e->value);
+      }
+      if(end > n) {
+        std::array<S,N> fm, z;
+        for(std::size_t i = 0; i < N; i++) {
+          fm[i] = ctl[freq(i)];
+          z[i] = ctl[index(i)];
+        }
+        process(dst + n,end - n,ctl[amp],ctl[carrier],fm,z);
+      }
+      n = end;
+    } while(n < nframes);
+    now += nframes;
+  }
+
+  /**
+     six-parameter form of process() (N = 2)
+  */
+  void process(float *dst,std::size_t nframes,S a,S fc,
+               S fm0,S fm1,S z0,S z1){
+    static_assert(N == 2, "six-parameter form needs N = 2");
+    process(dst,nframes,a,fc,{fm0,fm1},{z0,z1});
+  }
+
+  /**
+     six-parameter form with audio-rate parameters (N = 2)
+  */
+  template<typename A,typename C,typename F,typename Z,
+           typename = std::enable_if_t<!(std::is_arithmetic<A>::value &&
+                                         std::is_arithmetic<C>::value &&
+                                         std::is_arithmetic<F>::value &&
+                                         std::is_arithmetic<Z>::value)>>
+  void process(float *dst,std::size_t nframes,const A &a,const C &fc,
+               const F &fm0,const F &fm1,const Z &z0,const Z &z1){
+    static_assert(N == 2, "six-parameter form needs N = 2");
+    process(dst,nframes,a,fc,std::array<F,N>{fm0,fm1},
+            std::array<Z,N>{z0,z1});
+  }
+
+  /**
+     S a: signal amplitude
+     S fc: carrier freq
+     S fm0: zero-level fm
+     S fm1: first-level fm
+     S z0: zero-level mod index
+     S z1: first-level mod index
+  */
+  const std::vector<float> &operator()(S a,S fc,
+                                       S fm0,S fm1,
+				       S z0,S z1){
+    static_assert(N == 2, "six-parameter form needs N = 2");
+    return (*this)(a,fc,{fm0,fm1},{z0,z1});
+  }
+
+  /**
+     audio synthesis method (N+1 passes)
+     reference path, one operator over the whole block
+     at a time; bit-exact with the fused kernel
+     unless the compiler contracts to FMA differently
+     in the two loops (-ffp-contract=off)
+  */
+  const std::vector<float> &multipass(S a,S fc,
+                                      const std::array<S,N> &fm,
+                                      const std::array<S,N> &z){
+    mods[0](z[0],fm[0]);
+    for(std::size_t i = 1; i < N; i++)
+      mods[i](z[i],fm[i],mods[i-1]());
+    auto &c = car(a,fc,mods[N-1]());
+    std::copy(c.begin(),c.end(),buf.begin());
+    dec(buf.data(),out.data());
+    return out;
   }
 };
 
 /**
-   Stacked FM template class
-   takes sample type
+   Stacked PM template class
+   takes sample type, number of modulators N and wave
+   evaluation policy.
+   Phase-modulation form of StackedFM: each modulator
+   adds z*sin(phase) to the next operator's phase
+   instead of z*f*cos(phase) to its frequency. This is
+   the integral of the FM modulation, computed exactly,
+   so the carrier phase does not drift and no
+   oversampling is needed.
 */
-class StackedFM {
-  std::vector<double> table;
-  Op<float> mod0; 
-  Op<float> mod1;
-  Op<float> car;
+template<typename S = float, std::size_t N = 2, typename W = Linear>
+class StackedPM {
+  static_assert(N > 0, "StackedPM needs at least one modulator");
+  std::array<Op<S,W>,N> mods;
+  Op<S,W> car;
   std::vector<float> out;
-  std::size_t ovs;
-  SRC_STATE* stat;
-  SRC_DATA cvt;
-  
+
+  template<std::size_t... I>
+  static std::array<Op<S,W>,N> make(unsigned int sr, std::size_t vs,
+                                  std::shared_ptr<const Table<S>> t,
+                                  std::index_sequence<I...>) {
+    return {{((void) I, Op<S,W>(sr,vs,t))...}};
+  }
+
 public:
-  StackedFM(unsigned int fs,std::size_t os,
-            std::size_t vsize = def_vsize) :
-    table(1025),mod0(table,fs*os,vsize*os),
-    mod1(table,fs*os,vsize*os),
-    car(table,fs*os,vsize*os),
-    out(vsize),ovs(os){
-    int err;
-    stat = src_new (SRC_SINC_FASTEST,1,&err);
-    cvt.src_ratio = 1./ovs;
-    cvt.input_frames = vsize*ovs;
-    cvt.data_in = car.data();
-    cvt.output_frames = vsize;
-    cvt.data_out = out.data();
-    cvt.end_of_input = 0;
-    std::size_t n = 0;
-    for(auto &s : table)
-      s = std::cos(twopi/(table.size()-1)*n++);
-  };
+  using sample = S;
 
-  ~StackedFM(){src_delete(stat);}
+  /**
+     unsigned int fs: sampling rate
+     std::size_t vsize: signal vector size
+     table: wave table shared by the operators
+  */
+  StackedPM(unsigned int fs,std::size_t vsize = def_vsize,
+            std::shared_ptr<const Table<S>> table =
+            ::table<S>()) :
+    mods(make(fs,vsize,table,std::make_index_sequence<N>())),
+    car(fs,vsize,table),out(vsize){ };
 
   unsigned int vsize(){return out.size();}
-  unsigned int fs(){return car.sr()/ovs;}
+  unsigned int fs(){return car.sr();}
+  static constexpr std::size_t order(){return N;}
   const float *data() {return out.data();}
 
-  const std::vector<float> &operator()(float a,float fc,
-                                       float fm0,float fm1,
-				       float z0,float z1){
-    mod0(z0,fm0);
-    mod1(z1,fm1,mod0());
-    car(a,fc,mod1());
-    src_process(stat, &cvt);
+  /**
+     returns the output delay in samples (none)
+  */
+  double delay(){return 0;}
+
+  /**
+     audio synthesis method
+     S a: signal amplitude
+     S fc: carrier freq
+     fm: modulator freqs, zero-level first
+     z: modulation indices (radians), zero-level first
+  */
+  const std::vector<float> &operator()(S a,S fc,
+                                       const std::array<S,N> &fm,
+                                       const std::array<S,N> &z){
+    process(out.data(),out.size(),a,fc,fm,z);
     return out;
   }
-};
 
+  /**
+     audio synthesis into a caller buffer
+     float *dst: output, nframes samples (any number)
+     std::size_t nframes: frames to render
+     other parameters as operator()
+  */
+  void process(float *dst,std::size_t nframes,S a,S fc,
+               const std::array<S,N> &fm,const std::array<S,N> &z){
+    const S q = (S) (twopi/4);  // cos table: sin x = cos(x - pi/2)
+    unsigned int p[N], pc;
+    S b;
+    for(std::size_t i = 0; i < N; i++) mods[i].load(p[i],b);
+    car.load(pc,b);
+    for(std::size_t n = 0; n < nframes; n++) {
+      S m = 0;
+      for(std::size_t i = 0; i < N; i++)
+        m = mods[i].pm(z[i],fm[i],m - q,p[i]);
+      dst[n] = (float) car.pm(a,fc,m,pc);
+    }
+    for(std::size_t i = 0; i < N; i++) mods[i].store(p[i],0);
+    car.store(pc,0);
+  }
+
+  /**
+     six-parameter form of process() (N = 2)
+  */
+  void process(float *dst,std::size_t nframes,S a,S fc,
+               S fm0,S fm1,S z0,S z1){
+    static_assert(N == 2, "six-parameter form needs N = 2");
+    process(dst,nframes,a,fc,{fm0,fm1},{z0,z1});
+  }
 
+  /**
+     S a: signal amplitude
+     S fc: carrier freq
+     S fm0: zero-level fm
+     S fm1: first-level fm
+     S z0: zero-level mod index
+     S z1: first-level mod index
+  */
+  const std::vector<float> &operator()(S a,S fc,
+                                       S fm0,S fm1,
+                                       S z0,S z1){
+    static_assert(N == 2, "six-parameter form needs N = 2");
+    return (*this)(a,fc,{fm0,fm1},{z0,z1});
+  }
+};
 
+#ifndef FM_NO_MAIN  // engine only (see fmbench.cpp)
 int main(int argc, const char* argv[]) {
   if(argc > 3) {
-    int ovs = argc>5?std::atoi(argv[5]):8;
+    // osr aN: adaptive oversampling up to N, pm: StackedPM
+    bool adapt = argc>5 && argv[5][0] == 'a';
+    bool pm = argc>5 && std::strcmp(argv[5],"pm") == 0;
+    int ovs = argc>5?std::atoi(argv[5]+adapt):8;
     int sr = argc>4?std::atoi(argv[4]):def_sr;
     auto dur = std::atof(argv[1]);
     auto amp = std::atof(argv[2]);
     auto fr = std::atof(argv[3]);
-    StackedFM fm(sr,ovs);
-    for(std::size_t n = 0; n < fm.fs()*dur;
-        n += fm.vsize()) {
-      auto &sig = fm(amp,fr,fr,fr,3,2);
-      for(auto s : sig)
-        std::cout << s << std::endl;
+    const char *dest = argc>6?argv[6]:"txt";
+    auto render = [&](auto &write) {
+      auto run = [&](auto &fm) {
+        for(std::size_t n = 0; n < fm.fs()*dur;
+            n += fm.vsize()) {
+          RT_CHECK(fm(amp,fr,fr,fr,3,2));
+          write(fm.data(),fm.vsize());
+        }
+      };
+      // tuned evaluator and precision ($FM_TUNING, tune.h)
+      dispatch(tuning().wave,tuning().dbl,[&](auto s,auto w) {
+          using S = decltype(s);
+          using W = decltype(w);
+          auto t = ::table<S>(tuning().tab);
+          if(pm) {
+            StackedPM<S,2,W> fm(sr,def_vsize,t);
+            run(fm);
+          } else {
+            StackedFM<S,2,W> fm(sr,ovs,def_vsize,Decimator::MEDIUM,t);
+            if(adapt) fm.adaptive();
+            if(argc>7) {
+              auto t = std::make_shared<const Offsets>(argv[7]);
+              if(t->size()) {
+                if(!t->matches(sizeof(S),tuning().tab,fm.fs()*fm.factor()))
+                  std::cerr << argv[7] << " was solved for another "
+                    "precision, table size or rate" << std::endl;
+                fm.offsets(t);
+              }
+              else std::cerr << "cannot read " << argv[7] << std::endl;
+            }
+            fm.start({(S) fr,(S) fr},{3,2});
+            run(fm);
+          }
+        });
+    };
+    bool fail = false;
+    if(SndWriter::format(dest)) {
+      SndWriter write(dest,sr);
+      if(write.ok()) render(write);
+      if(!write.flush()) {
+        std::cerr << write.error() << std::endl;
+        fail = true;
+      }
+    } else {
+      Output write(Output::format(dest));
+      if(write.ok()) render(write);
+      else {
+        std::cerr << "unknown output format " << dest << std::endl;
+        fail = true;
+      }
     }
+    if(fail) return 1;
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz) [sr] [osr]" << std::endl;
+      " dur(s) amp freq(Hz) [sr] [osr|aN|pm] [fmt|file.wav|file.flac] [offsets]" << std::endl;
   return 0;
 }
+#endif
@@ -0,0 +1,37 @@
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include "output.h"
+#include "opbank.h"
+#include "alloccount.h"
+const std::size_t def_vsize = 64;
+const unsigned int def_sr = 44100;
+const std::size_t voices = 8;
+
+int main(int argc, const char* argv[]) {
+  if(argc > 3) {
+    int sr = argc>4?std::atoi(argv[4]):def_sr;
+    auto dur = std::atof(argv[1]);
+    auto amp = std::atof(argv[2]);
+    auto fr = std::atof(argv[3]);
+
+    // feedback operators on a harmonic series
+    const char *dest = argc>5?argv[5]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
+    OpBank<float,voices> fm(sr,def_vsize);
+    for(std::size_t v = 0; v < voices; v++)
+      fm.set(v,amp/voices,fr*(v+1),1);
+    for(std::size_t n = 0; n < fm.sr()*dur;
+        n += fm.vsize()) {
+      RT_CHECK(fm.synth());
+      write(RT_CHECK(fm.mix()));
+    }
+  } else
+    std::cout << "usage: " << argv[0] <<
+      " dur(s) amp freq(Hz) [sr] [fmt]" << std::endl;
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <samplerate.h>
+#include "output.h"
+#include "alloccount.h"
+#include "sfwriter.h"
+#include "op.h"
+#include "decimator.h"
+#include "offsets.h"
+#include "tune.h"
+#include "param.h"
+#include "events.h"
+#include "ticks.h"
+
+// every variant's engine, each in its own namespace
+#define FM_NO_MAIN
+namespace v0 {
+#include "fm_v0.cpp"
+}
+namespace v1 {
+#include "fm_v1.cpp"
+}
+namespace v2 {
+#include "fm_v2.cpp"
+}
+namespace v3 {
+#include "fm_v3.cpp"
+}
+namespace v4 {
+#include "fm_v4.cpp"
+}
+namespace v5 {
+#include "fm_v5.cpp"
+}
+namespace v6 {
+#include "fm_v6.cpp"
+}
+namespace v7 {
+#include "fm_v7.cpp"
+}
+const double twopi = 2*M_PI;
+
+/**
+   Benchmark result: per output sample (ns, TSC cycles)
+   and output samples per second
+*/
+struct Result {
+  const char *engine;
+  const char *type;
+  std::size_t vsize;
+  unsigned int sr;
+  std::size_t ovs;
+  double ns;
+  double sps;
+  double cycles;
+};
+
+static volatile double sink;
+
+/**
+   times dur seconds of output, best of reps runs
+   B block: renders one block, returns a sample of it
+*/
+template<typename B>
+Result measure(B &&block, std::size_t vsize, unsigned int sr,
+               double dur, int reps) {
+  std::size_t blocks = (std::size_t) std::ceil(dur*sr/vsize);
+  double acc = 0, best = 1e300, cyc = 0;
+  for(std::size_t n = 0; n < blocks/10 + 1; n++) acc += block();
+  for(int r = 0; r < reps; r++) {
+    auto c0 = ticks();
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t n = 0; n < blocks; n++) acc += block();
+    auto t1 = std::chrono::steady_clock::now();
+    auto c1 = ticks();
+    double t = std::chrono::duration<double>(t1 - t0).count();
+    if(t < best) {
+      best = t;
+      cyc = (double) (c1 - c0);
+    }
+  }
+  sink = acc;
+  double ns = blocks*vsize;
+  return {nullptr, nullptr, vsize, sr, 1,
+          best*1e9/ns, ns/best, cyc/ns};
+}
+
+template<typename S>
+std::vector<S> costab(std::size_t size) {
+  std::vector<S> tab(size);
+  std::size_t n = 0;
+  for(auto &s : tab)
+    s = (S) std::cos(n++ * twopi/(tab.size()-1));
+  return tab;
+}
+
+/**
+   runs every engine that supports sample type S
+   at one block size and sampling rate
+*/
+template<typename S>
+void bench(std::vector<Result> &res, const char *only,
+           std::size_t vs, unsigned int sr,
+           const std::vector<std::size_t> &ovs,
+           double dur, int reps) {
+  const S a = .5, fr = 440, z0 = 3, z1 = 2;
+  const char *type = std::is_same<S,float>::value ? "float" : "double";
+  auto run = [&](const char *name, std::size_t os, auto &&block) {
+    if(only && std::strcmp(only, name)) return;
+    Result r = measure(block, vs, sr, dur, reps);
+    r.engine = name;
+    r.type = type;
+    r.ovs = os;
+    res.push_back(r);
+  };
+
+  if constexpr (std::is_same<S,double>::value) {
+    // v0, v1 oscillators are double only
+    v0::StackedFM<S> e0(sr, vs);
+    run("v0", 1, [&]{ return e0.audio(a,fr,fr,fr,z0,z1)[0]; });
+    v1::StackedFM<S> e1(sr, vs);
+    run("v1", 1, [&]{ return e1(a,fr,fr,fr,z0,z1)[0]; });
+  }
+  v2::StackedFM<S> e2(sr, vs);
+  run("v2", 1, [&]{ return e2(a,fr,fr,fr,z0,z1)[0]; });
+  auto big = costab<S>(65537), tab = costab<S>(1025);
+  v3::StackedFM<S> e3(big, sr, vs);
+  run("v3", 1, [&]{ return e3(a,fr,fr,fr,z0,z1)[0]; });
+  v4::StackedFM<S> e4(tab, sr, vs);
+  run("v4", 1, [&]{ return e4(a,fr,fr,fr,z0,z1)[0]; });
+  v5::StackedFM<S> e5(tab, sr, vs);
+  run("v5", 1, [&]{ return e5(a,fr,fr,fr,z0,z1)[0]; });
+  for(auto os : ovs) {
+    if constexpr (std::is_same<S,float>::value) {
+      // v6 converts with libsamplerate, float only
+      v6::StackedFM<S> e6(tab, sr*os, vs*os);
+      std::vector<float> out(vs);
+      int err;
+      SRC_STATE *st = src_new(SRC_SINC_FASTEST, 1, &err);
+      SRC_DATA cvt;
+      std::memset(&cvt, 0, sizeof(cvt));
+      cvt.src_ratio = 1./os;
+      cvt.input_frames = e6.vsize();
+      cvt.output_frames = vs;
+      cvt.data_out = out.data();
+      cvt.data_in = e6.data();
+      run("v6", os, [&]{
+          e6(a,fr,fr,fr,z0,z1);
+          src_process(st, &cvt);
+          return out[0];
+        });
+      src_delete(st);
+    }
+    v7::StackedFM<S> e7(sr, os, vs);
+    run("v7", e7.factor(), [&]{ return e7(a,fr,fr,fr,z0,z1)[0]; });
+  }
+  // index ramps (audio-rate parameters)
+  v7::StackedFM<S> er(sr, 1, vs);
+  std::vector<float> ro(vs);
+  run("v7ramp", 1, [&]{
+      er.process(ro.data(), vs, a, fr, fr, fr, line(z0, z0),
+                 line(z1, z1));
+      return ro[0];
+    });
+  v7::StackedPM<S> pm(sr, vs);
+  run("v7pm", 1, [&]{ return pm(a,fr,fr,fr,z0,z1)[0]; });
+}
+
+void json(const std::vector<Result> &res) {
+  std::printf("{\n  \"compiler\": \"%s\",\n  \"results\": [\n",
+              __VERSION__);
+  for(std::size_t n = 0; n < res.size(); n++) {
+    const Result &r = res[n];
+    std::printf("    {\"engine\": \"%s\", \"type\": \"%s\", "
+                "\"vsize\": %zu, \"sr\": %u, \"ovs\": %zu, "
+                "\"ns_per_sample\": %.4f, \"samples_per_s\": %.0f, "
+                "\"cycles_per_sample\": %.3f}%s\n",
+                r.engine, r.type, r.vsize, r.sr, r.ovs, r.ns,
+                r.sps, r.cycles, n + 1 < res.size() ? "," : "");
+  }
+  std::printf("  ]\n}\n");
+}
+
+void text(const std::vector<Result> &res) {
+  std::printf("%-6s %-6s %6s %6s %4s %10s %12s %10s\n", "engine",
+              "type", "vsize", "sr", "ovs", "ns/smp", "smp/s",
+              "cyc/smp");
+  for(auto &r : res)
+    std::printf("%-6s %-6s %6zu %6u %4zu %10.3f %12.0f %10.2f\n",
+                r.engine, r.type, r.vsize, r.sr, r.ovs, r.ns, r.sps,
+                r.cycles);
+}
+
+int main(int argc, const char* argv[]) {
+  if(argc > 1 && argv[1][0] == '-') {
+    std::cout << "usage: " << argv[0] <<
+      " [dur(s)] [txt|json] [engine]" << std::endl;
+    return 0;
+  }
+  double dur = argc > 1 ? std::atof(argv[1]) : 1.;
+  bool js = argc > 2 && std::strcmp(argv[2], "json") == 0;
+  const char *only = argc > 3 ? argv[3] : nullptr;
+  const int reps = 3;
+  const std::vector<std::size_t> vsizes = {16, 64, 256};
+  const std::vector<unsigned int> rates = {44100, 96000};
+  const std::vector<std::size_t> ovs = {1, 2, 4, 8};
+  std::vector<Result> res;
+  for(auto vs : vsizes)
+    for(auto sr : rates) {
+      bench<float>(res, only, vs, sr, ovs, dur, reps);
+      bench<double>(res, only, vs, sr, ovs, dur, reps);
+    }
+  if(js) json(res);
+  else text(res);
+  return 0;
+}
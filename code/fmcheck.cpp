@@ -0,0 +1,91 @@
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+// the fused kernel hands m*z + fm on in a register, which
+// GCC would contract to an FMA where multipass() cannot
+// (-ffp-contract=fast is its default): keep both exact
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+#define FM_NO_MAIN
+#include "fm_v7.cpp"
+
+/**
+   renders blocks with swept parameters through
+   StackedFM<S,2,W> engines at oversampling ovs, three
+   through the fused kernel, with static parameters
+   (operator(); the AVX2 lanes where built), spans and
+   flat ramps (process(); the scalar loop), and one
+   through the N+1 pass reference (multipass()), and
+   returns the number of blocks where a fused output
+   differs from the reference in any bit. The vector
+   size is not a multiple of 8, so the SIMD body and
+   its scalar tail both run.
+*/
+template<typename S, typename W>
+std::size_t check(const char *name, std::size_t ovs, std::size_t blocks) {
+  const unsigned int sr = def_sr;
+  const std::size_t vs = 61;
+  const char *kind[3] = {"static", "span", "ramp"};
+  StackedFM<S,2,W> stat(sr,ovs,vs), span(sr,ovs,vs), ramp(sr,ovs,vs),
+    multi(sr,ovs,vs);
+  std::vector<float> out[3] = {std::vector<float>(vs),
+                               std::vector<float>(vs),
+                               std::vector<float>(vs)};
+  std::vector<S> sfc(vs), sfm0(vs), sfm1(vs), sz0(vs), sz1(vs);
+  std::size_t bad[3] = {0, 0, 0}, first[3] = {blocks, blocks, blocks};
+  double err[3] = {0, 0, 0};
+  for(std::size_t n = 0; n < blocks; n++) {
+    // sweeps carrier, ratios and indices, through
+    // near-zero and above-Nyquist modulator frequencies
+    double t = (double) n/blocks;
+    S fc = (S) (50 + 4000*t);
+    S fm0 = (S) (fc*(1 + 2*std::sin(7*t))), fm1 = (S) (fc*(.5 + t));
+    S z0 = (S) (3*std::fabs(std::cos(5*t))), z1 = (S) (8*t);
+    auto &s = stat(.5,fc,fm0,fm1,z0,z1);
+    std::copy(s.begin(),s.end(),out[0].begin());
+    std::fill(sfc.begin(),sfc.end(),fc);
+    std::fill(sfm0.begin(),sfm0.end(),fm0);
+    std::fill(sfm1.begin(),sfm1.end(),fm1);
+    std::fill(sz0.begin(),sz0.end(),z0);
+    std::fill(sz1.begin(),sz1.end(),z1);
+    span.process(out[1].data(),vs,(S) .5,sfc.data(),
+                 sfm0.data(),sfm1.data(),sz0.data(),sz1.data());
+    ramp.process(out[2].data(),vs,line((S) .5,(S) .5),line(fc,fc),
+                 line(fm0,fm0),line(fm1,fm1),line(z0,z0),line(z1,z1));
+    auto &b = multi.multipass(.5,fc,{fm0,fm1},{z0,z1});
+    for(std::size_t i = 0; i < 3; i++)
+      if(std::memcmp(out[i].data(),b.data(),vs*sizeof(float))) {
+        if(!bad[i]++) first[i] = n;
+        for(std::size_t j = 0; j < vs; j++)
+          err[i] = std::max(err[i],(double) std::fabs(out[i][j] - b[j]));
+      }
+  }
+  for(std::size_t i = 0; i < 3; i++) {
+    std::printf("%-8s %-6s ovs %2zu: %s", name, kind[i], ovs,
+                bad[i] ? "DIFFERS" : "bit-exact");
+    if(bad[i]) std::printf(" (%zu of %zu blocks, first %zu, max %.3e)",
+                           bad[i], blocks, first[i], err[i]);
+    std::printf("\n");
+  }
+  return bad[0] + bad[1] + bad[2];
+}
+
+int main(int argc, const char* argv[]) {
+  if(argc > 1 && argv[1][0] == '-') {
+    std::cout << "usage: " << argv[0] << " [blocks]" << std::endl;
+    return 0;
+  }
+  std::size_t blocks = argc > 1 ? std::strtoul(argv[1],nullptr,10) : 5000;
+  std::size_t bad = 0;
+  for(std::size_t ovs : {1, 2, 8}) {
+    bad += check<float,Linear>("float", ovs, blocks);
+    bad += check<double,Linear>("double", ovs, blocks);
+    bad += check<float,Cubic>("cubic", ovs, blocks);
+  }
+  return bad ? 1 : 0;
+}
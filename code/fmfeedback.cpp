@@ -2,6 +2,8 @@
 #include <cmath>
 #include <iostream>
 #include <cstdlib>
+#include "output.h"
+#include "alloccount.h"
 #include <samplerate.h>
 const double twopi = 2*M_PI;
 const std::size_t def_vsize = 64;
@@ -78,15 +80,20 @@ int main(int argc, const char* argv[]) {
     for(auto &s : table)
       s = std::cos(twopi/(table.size()-1)*n++);
     
-    Op<float> fm(table,sr,ovs);
+    const char *dest = argc>5?argv[5]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
+    Op<float> fm(table,sr,def_vsize);
     for(std::size_t n = 0; n < fm.sr()*dur;
         n += fm.vsize()) {
-      auto &sig = fm(amp,fr,1);
-      for(auto s : sig)
-        std::cout << s << std::endl;
+      auto &sig = RT_CHECK(fm(amp,fr,1));
+      write(sig);
     }
   } else
     std::cout << "usage: " << argv[0] <<
-      " dur(s) amp freq(Hz) [sr] [osr]" << std::endl;
+      " dur(s) amp freq(Hz) [sr] [fmt]" << std::endl;
   return 0;
 }
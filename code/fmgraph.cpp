@@ -0,0 +1,46 @@
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include "output.h"
+#include "opgraph.h"
+#include "alloccount.h"
+const std::size_t def_vsize = 64;
+const unsigned int def_sr = 44100;
+
+int main(int argc, const char* argv[]) {
+  if(argc > 3) {
+    int sr = argc>4?std::atoi(argv[4]):def_sr;
+    auto dur = std::atof(argv[1]);
+    auto amp = std::atof(argv[2]);
+    auto fr = std::atof(argv[3]);
+    // one feedback modulator shared by two carriers,
+    // two parallel modulators summed into a third
+    OpGraph<float> fm(sr,def_vsize);
+    auto m0 = fm.add(2,fr,.5);
+    auto c0 = fm.add(amp/3,fr,0,true);
+    auto c1 = fm.add(amp/3,fr*2,0,true);
+    auto m1 = fm.add(1,fr*3);
+    auto m2 = fm.add(1.5,fr*.5);
+    auto c2 = fm.add(amp/3,fr,0,true);
+    fm.connect(m0,c0);
+    fm.connect(m0,c1);
+    fm.connect(m1,c2);
+    fm.connect(m2,c2);
+    if(!fm.compile()) {
+      std::cerr << "algorithm has a cycle" << std::endl;
+      return 1;
+    }
+    const char *dest = argc>5?argv[5]:"txt";
+    Output write(Output::format(dest));
+    if(!write.ok()) {
+      std::cerr << "unknown output format " << dest << std::endl;
+      return 1;
+    }
+    for(std::size_t n = 0; n < fm.sr()*dur;
+        n += fm.vsize())
+      write(RT_CHECK(fm()));
+  } else
+    std::cout << "usage: " << argv[0] <<
+      " dur(s) amp freq(Hz) [sr] [fmt]" << std::endl;
+  return 0;
+}
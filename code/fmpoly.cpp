@@ -0,0 +1,83 @@
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#define FM_NO_MAIN
+#include "fm_v7.cpp"
+#include "voices.h"
+#include "workers.h"
+const std::size_t poly = 16;
+
+int main(int argc, const char* argv[]) {
+  if(argc > 2) {
+    auto dur = std::atof(argv[1]);
+    auto amp = std::atof(argv[2]);
+    int ovs = argc>3?std::atoi(argv[3]):2;
+    auto steal = argc>4 && std::strcmp(argv[4],"oldest") == 0 ?
+      Voices<StackedFM<>,poly>::OLDEST : Voices<StackedFM<>,poly>::QUIETEST;
+    const char *dest = argc>5?argv[5]:"txt";
+    int nt = argc>6?std::atoi(argv[6]):1;
+    const unsigned int sr = def_sr;
+
+    // the paper's stack on every note: fc = fm0 = fm1
+    Voices<StackedFM<>,poly> synth(sr,{{1,1},{3,2},.01,.5},
+                                   def_vsize,steal,.005,ovs);
+    std::vector<float> out(def_vsize);
+    Workers pool(nt,def_vsize,poly);
+
+    // an arpeggio of overlapping notes, a new one every
+    // 50 ms, each held 400 ms
+    const int seq[] = {0, 4, 7, 11, 14, 11, 7, 4};
+    const std::size_t step = sr/20, hold = 8*step;
+    auto render = [&](auto &write) {
+      for(std::size_t n = 0, k = 0, j = 0; n < sr*dur;
+          n += out.size()) {
+        for(; n >= k*step; k++) {
+          int key = 48 + seq[k % 8] + 12*((k/8) % 2);
+          synth.on((int) k,(float) (440*std::pow(2.,(key - 69)/12.)),
+                   (float) amp/4);
+        }
+        for(; j < k && n >= j*step + hold; j++) synth.off((int) j);
+        if(nt > 1) RT_CHECK(synth.process(out.data(),out.size(),pool));
+        else RT_CHECK(synth.process(out.data(),out.size()));
+        write(out.data(),out.size());
+      }
+    };
+    bool fail = false;
+    if(SndWriter::format(dest)) {
+      SndWriter write(dest,sr);
+      if(write.ok()) render(write);
+      if(!write.flush()) {
+        std::cerr << write.error() << std::endl;
+        fail = true;
+      }
+    } else {
+      Output write(Output::format(dest));
+      if(write.ok()) render(write);
+      else {
+        std::cerr << "unknown output format " << dest << std::endl;
+        fail = true;
+      }
+    }
+    auto &st = synth.stats();
+    std::fprintf(stderr, "voices %zu, peak %zu, stolen %zu, "
+                 "rendered %zu, skipped %zu, %.0f ns per voice block\n",
+                 synth.size(), st.peak, st.stolen, st.rendered,
+                 st.skipped, st.per_voice());
+    if(nt > 1) {
+      auto &ws = pool.stats();
+      std::fprintf(stderr, "workers %zu, %.0f ns per block (worst %.0f), "
+                   "%zu steals, utilisation", pool.size(),
+                   ws.wall/ws.blocks, ws.worst, ws.steals);
+      for(std::size_t w = 0; w < pool.size(); w++)
+        std::fprintf(stderr, " %.2f", ws.utilisation(w));
+      std::fprintf(stderr, "\n");
+    }
+    if(fail) return 1;
+  } else
+    std::cout << "usage: " << argv[0] <<
+      " dur(s) amp [osr] [quietest|oldest] [fmt|file.wav|file.flac] "
+      "[threads]" << std::endl;
+  return 0;
+}
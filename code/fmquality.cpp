@@ -0,0 +1,266 @@
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <complex>
+#include <chrono>
+#include <numeric>
+#include <string>
+#include <iostream>
+#define FM_NO_MAIN
+#include "fm_v7.cpp"
+#include "ticks.h"
+#include "tune.h"
+
+using S = float;
+
+/**
+   Test signal: stacked FM with harmonic ratios
+   (fc = fm0 = fm1 = f) in its exact form, nested phase
+   modulation, with phases computed in double precision
+   from the sample time (no accumulation)
+*/
+struct Signal {
+  double amp, f, z0, z1;
+  double phase(double t) const {
+    double w = twopi*f*t;
+    return w + z1*std::sin(w + z0*std::sin(w));
+  }
+  double operator()(double t) const { return amp*std::cos(phase(t)); }
+};
+
+struct Config {
+  const char *engine;  // fm or pm
+  int wave;            // evaluator (Eval, tune.h)
+  bool dbl;            // double precision (reference)
+  std::size_t tab;     // table size, 0 if none
+  std::size_t ovs;     // oversampling
+  int quality;         // Decimator::Quality, -1 if none
+};
+
+/**
+   Quality and cost of one configuration
+*/
+struct Measure {
+  Config cfg;
+  double ns;       // per output sample
+  double cycles;   // per output sample (TSC)
+  double snr;      // against the reference (dB)
+  double alias;    // inharmonic energy re total (dB)
+  double drift;    // carrier phase drift (rad/s)
+  double phase;    // carrier phase error at the end (rad)
+  bool pareto;
+};
+
+/**
+   renders dur seconds with engines from make(), reps
+   times for the cost (best run), and measures the first
+   render against the reference delayed by the engine's
+   delay
+*/
+template<typename M>
+Measure measure(M &&make, const Signal &sig, unsigned int sr,
+                double dur, int reps) {
+  std::vector<float> y;
+  double secs = 1e300, delay = 0;
+  unsigned long long cyc = 0;
+  S f = sig.f;
+  for(int r = 0; r < reps; r++) {
+    auto fm = make();
+    std::size_t vs = fm.vsize();
+    std::size_t blocks = (std::size_t) std::ceil(dur*sr/vs);
+    y.resize(blocks*vs);
+    delay = fm.delay();
+    auto c0 = ticks();
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t b = 0; b < blocks; b++) {
+      auto &o = fm((S) sig.amp,f,f,f,(S) sig.z0,(S) sig.z1);
+      if(r == 0) std::copy(o.begin(), o.end(), y.begin() + b*vs);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    auto c1 = ticks();
+    double t = std::chrono::duration<double>(t1 - t0).count();
+    if(t < secs) {
+      secs = t;
+      cyc = c1 - c0;
+    }
+  }
+
+  // SNR and carrier phase error per 10 ms window,
+  // linearised: y - a*cos(p) = -a*sin(p)*err
+  const std::size_t skip = 2048, win = sr/100;
+  double sp = 0, ep = 0;
+  std::vector<double> tk, dk;
+  for(std::size_t n = skip; n + win <= y.size(); n += win) {
+    double num = 0, den = 0;
+    for(std::size_t k = n; k < n + win; k++) {
+      double t = (k - delay)/sr, p = sig.phase(t);
+      double r = sig.amp*std::cos(p), e = y[k] - r, s = std::sin(p);
+      sp += r*r;
+      ep += e*e;
+      num -= e*s;
+      den += sig.amp*s*s;
+    }
+    tk.push_back((n + win/2.)/sr);
+    dk.push_back(num/den);
+  }
+  double tm = std::accumulate(tk.begin(), tk.end(), 0.)/tk.size();
+  double dm = std::accumulate(dk.begin(), dk.end(), 0.)/dk.size();
+  double sxy = 0, sxx = 0;
+  for(std::size_t k = 0; k < tk.size(); k++) {
+    sxy += (tk[k] - tm)*(dk[k] - dm);
+    sxx += (tk[k] - tm)*(tk[k] - tm);
+  }
+
+  // inharmonic energy over windows of a whole number of
+  // periods, where the harmonics fall on exact DFT bins;
+  // aliases of the harmonics land between them unless
+  // sr is a multiple of f
+  std::size_t per = sr/std::gcd(sr, (unsigned int) sig.f);
+  double tot = 0, inh = 0;
+  for(std::size_t n = skip, w = 0; n + per <= y.size() && w < 10;
+      n += per, w++) {
+    double e = 0, h = 0;
+    for(std::size_t k = n; k < n + per; k++) e += (double) y[k]*y[k];
+    for(std::size_t m = 0; 2*m*sig.f <= sr; m++) {
+      std::complex<double> x = 0, w1 = std::polar(1., -twopi*m*sig.f/sr),
+        r = 1;
+      for(std::size_t k = n; k < n + per; k++, r *= w1) x += r*(double) y[k];
+      double side = m == 0 || 2*m*sig.f == sr ? 1 : 2;
+      h += side*std::norm(x)/per;
+    }
+    tot += e;
+    inh += std::max(e - h, 0.);
+  }
+
+  double ns = (double) y.size();
+  return {{}, secs*1e9/ns, cyc/ns, 10*std::log10(sp/ep),
+      tot > 0 ? 10*std::log10(inh/tot + 1e-30) : NAN,
+      sxx > 0 ? sxy/sxx : 0, dk.empty() ? 0 : dk.back(), false};
+}
+
+
+/**
+   renders and measures configuration c with sample and
+   table precision T and wave evaluation policy W (sine.h)
+*/
+template<typename T, typename W>
+Measure run(const Config &c, const Signal &sig, unsigned int sr,
+            double dur, int reps) {
+  auto t = c.tab ? table<T>(c.tab) : table<T>();
+  if(std::strcmp(c.engine, "pm") == 0)
+    return measure([&]{ return StackedPM<T,2,W>(sr, def_vsize, t); },
+                   sig, sr, dur, reps);
+  return measure([&]{
+      return StackedFM<T,2,W>(sr, c.ovs, def_vsize,
+                              (Decimator::Quality) std::max(c.quality, 0),
+                              t);
+    }, sig, sr, dur, reps);
+}
+
+const char *qname(int q) {
+  static const char *names[] = {"fast", "medium", "best"};
+  return q < 0 ? "-" : names[q];
+}
+
+void json(const std::vector<Measure> &res, const Signal &sig,
+          unsigned int sr) {
+  std::printf("{\n  \"compiler\": \"%s\",\n  \"sr\": %u, \"freq\": %g, "
+              "\"z0\": %g, \"z1\": %g,\n  \"results\": [\n",
+              __VERSION__, sr, sig.f, sig.z0, sig.z1);
+  for(std::size_t n = 0; n < res.size(); n++) {
+    const Measure &m = res[n];
+    std::printf("    {\"engine\": \"%s\", \"wave\": \"%s\", "
+                "\"type\": \"%s\", \"table\": %zu, \"ovs\": %zu, "
+                "\"decimator\": \"%s\", \"ns_per_sample\": %.3f, "
+                "\"cycles_per_sample\": %.2f, \"snr_db\": %.2f, "
+                "\"alias_db\": %.2f, \"drift_rad_per_s\": %.3e, "
+                "\"phase_err_rad\": %.3e, \"pareto\": %s}%s\n",
+                m.cfg.engine, eval_name(m.cfg.wave),
+                m.cfg.dbl ? "double" : "float", m.cfg.tab, m.cfg.ovs,
+                qname(m.cfg.quality), m.ns, m.cycles, m.snr, m.alias,
+                m.drift, m.phase, m.pareto ? "true" : "false",
+                n + 1 < res.size() ? "," : "");
+  }
+  std::printf("  ]\n}\n");
+}
+
+void text(const std::vector<Measure> &res) {
+  std::printf("%-3s %-7s %-6s %6s %4s %-7s %9s %9s %8s %8s %10s %10s\n",
+              "eng", "wave", "type", "table", "ovs", "dec", "ns/smp",
+              "cyc/smp", "snr", "alias", "drift", "phase");
+  for(auto &m : res)
+    std::printf("%-3s %-7s %-6s %6zu %4zu %-7s %9.2f %9.1f %8.1f %8.1f "
+                "%10.2e %10.2e%s\n", m.cfg.engine, eval_name(m.cfg.wave),
+                m.cfg.dbl ? "double" : "float", m.cfg.tab, m.cfg.ovs, qname(m.cfg.quality), m.ns, m.cycles,
+                m.snr, m.alias, m.drift, m.phase, m.pareto ? " *" : "");
+}
+
+int main(int argc, const char* argv[]) {
+  if(argc > 1 && argv[1][0] == '-') {
+    std::cout << "usage: " << argv[0] <<
+      " [dur(s)] [freq(Hz)] [z0] [z1] [target(dB)] [txt|json]"
+              << std::endl;
+    return 0;
+  }
+  double dur = argc > 1 ? std::atof(argv[1]) : 1.;
+  Signal sig{.5, argc > 2 ? (double) std::atoi(argv[2]) : 440.,
+             argc > 3 ? std::atof(argv[3]) : 3.,
+             argc > 4 ? std::atof(argv[4]) : 2.};
+  double target = argc > 5 ? std::atof(argv[5]) : 60.;
+  bool js = argc > 6 && std::strcmp(argv[6], "json") == 0;
+  const unsigned int sr = def_sr;
+  const int reps = 3;
+
+  // every decimator with float linear tables, the medium
+  // one with the other evaluators and the double
+  // reference; table-free evaluators once
+  std::vector<Config> cfgs;
+  for(int w : {LINEAR, TRUNCATE, CUBIC, COSINE, MINIMAX})
+    for(bool dbl : {false, true})
+      for(std::size_t tab : {257, 1025, 4097, 65537}) {
+        if(!eval_table(w)) tab = 0;
+        cfgs.push_back({"pm", w, dbl, tab, 1, -1});
+        cfgs.push_back({"fm", w, dbl, tab, 1, -1});
+        for(std::size_t os : {2, 4, 8, 16})
+          for(int q : {Decimator::FAST, Decimator::MEDIUM, Decimator::BEST})
+            if((w == LINEAR && !dbl) || q == Decimator::MEDIUM)
+              cfgs.push_back({"fm", w, dbl, tab, os, q});
+        if(!tab) break;
+      }
+
+  std::vector<Measure> res;
+  for(auto &c : cfgs) {
+    Measure m;
+    dispatch(c.wave, c.dbl, [&](auto s, auto w) {
+        m = run<decltype(s),decltype(w)>(c, sig, sr, dur, reps);
+      });
+    m.cfg = c;
+    res.push_back(m);
+  }
+
+  // Pareto front: nothing else is both cheaper and better
+  const Measure *best = nullptr;
+  for(auto &m : res) {
+    m.pareto = true;
+    for(auto &o : res)
+      if(o.ns <= m.ns && o.snr >= m.snr && (o.ns < m.ns || o.snr > m.snr))
+        m.pareto = false;
+    if(m.snr >= target && (!best || m.ns < best->ns)) best = &m;
+  }
+
+  if(js) json(res, sig, sr);
+  else {
+    text(res);
+    if(best)
+      std::printf("cheapest with SNR >= %g dB: %s %s %s table %zu ovs %zu "
+                  "decimator %s (%.2f ns/sample, %.1f dB)\n", target,
+                  best->cfg.engine, eval_name(best->cfg.wave),
+                  best->cfg.dbl ? "double" : "float",
+                  best->cfg.tab, best->cfg.ovs,
+                  qname(best->cfg.quality), best->ns, best->snr);
+    else std::printf("no configuration reaches %g dB\n", target);
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include "tune.h"
+
+int main(int argc, const char* argv[]) {
+  if(argc > 1 && argv[1][0] == '-') {
+    std::cout << "usage: " << argv[0] <<
+      " [target(dB)] [file] [dur(s)]" << std::endl;
+    return 0;
+  }
+  double db = argc > 1 ? std::atof(argv[1]) : 120.;
+  const char *env = std::getenv("FM_TUNING");
+  const char *path = argc > 2 ? argv[2] : env ? env : "fmtune.txt";
+  double secs = argc > 3 ? std::atof(argv[3]) : .1;
+
+  std::vector<Tuning> res;
+  Tuning best = autotune(db, secs, &res);
+  std::printf("L1 %zu, L2 %zu, L3 %zu bytes\n", cache_size(1),
+              cache_size(2), cache_size(3));
+  std::printf("%-7s %-6s %8s %9s %5s %8s %8s\n", "wave", "sample", "table",
+              "bytes", "cache", "ns/smp", "err(dB)");
+  for(auto &t : res) {
+    bool tab = eval_table(t.wave);
+    std::size_t bytes = t.bytes();
+    std::printf("%-7s %-6s %8zu %9zu %5s %8.2f %8.1f%s\n", eval_name(t.wave),
+                t.dbl ? "double" : "float", tab ? t.tab : 0, bytes,
+                !tab ? "-" : cache_level(bytes) == 1 ? "L1" :
+                cache_level(bytes) == 2 ? "L2" :
+                cache_level(bytes) == 3 ? "L3" : "mem",
+                t.ns, t.err, t.wave == best.wave && t.dbl == best.dbl &&
+                t.tab == best.tab ? " *" : "");
+  }
+  std::printf("best under %g dB: %s %s table %zu (%.2f ns/sample, "
+              "%.1f dB)\n", -db, eval_name(best.wave),
+              best.dbl ? "double" : "float",
+              eval_table(best.wave) ? best.tab : 0, best.ns, best.err);
+  if(!best.save(path)) {
+    std::cerr << "cannot write " << path << std::endl;
+    return 1;
+  }
+  std::cout << path << std::endl;
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include "op.h"
+#include "offsets.h"
+
+const double twopi = 2*M_PI;
+
+/**
+   carrier drift (cycles/s) of the digital m0 -> m1 stack
+   at ovs = 1, with the zero-level modulator starting at
+   phase ph: the slope of the carrier phase accumulated from
+   m1 against its exact integral z1*sin(phi1)/2pi, over a
+   whole number of periods. Runs the same Op steps as
+   StackedFM<S> on table t.
+*/
+template<typename S>
+double drift(double ph, S z0, S z1, S f0, S f1, unsigned int sr,
+             std::size_t len, std::shared_ptr<const Table<S>> t) {
+  Op<S> mod0(sr, 1, t), mod1(sr, 1, t);
+  mod0.reset(ph);
+  mod1.reset(0);
+  unsigned int p0, p1;
+  S b0, b1, m;
+  mod0.load(p0, b0);
+  mod1.load(p1, b1);
+  double w0 = twopi*f0/sr, w1 = twopi*f1/sr, s0 = std::sin(ph);
+  double acc = 0, sx = 0, sy = 0, sxy = 0, sxx = 0;
+  for(std::size_t n = 0; n < len; n++) {
+    double phi1 = w1*n + z0*(std::sin(w0*n + ph) - s0);
+    double e = acc - z1*std::sin(phi1)/twopi;
+    sx += n;
+    sy += e;
+    sxy += n*e;
+    sxx += (double) n*n;
+    m = 0;
+    mod0.step(z0, Op<S>::freq(f0, b0, 0, m), p0, b0, m);
+    mod1.step(z1, Op<S>::freq(f1, b1, 0, m), p1, b1, m);
+    acc += (double) m/sr;
+  }
+  return (len*sxy - sx*sy)/(len*sxx - sx*sx)*sr;
+}
+
+/**
+   solves one z0 row of the table, keeping to the zero of
+   the drift nearest prev (the previous z0's, or the
+   previous frequency's for the first) so that the offsets
+   can be interpolated; returns the first offset
+*/
+template<typename S>
+double row(Offsets &tab, std::size_t j, std::size_t k, std::size_t r,
+           double prev, unsigned int sr, double secs,
+           std::shared_ptr<const Table<S>> t) {
+  const std::size_t scan = 72;
+  S f0 = (S) (tab.freq(k)*sr), f1 = f0*(r + 1);
+  S z1 = (S) std::fmax(tab.z1(j), .1);
+  // a whole number of zero-level periods
+  std::size_t len = (std::size_t) std::lround(std::fmax(std::round(secs*f0),
+                                                        1)*sr/f0);
+  double first = NAN;
+  for(std::size_t i = 1; i < tab.z0s(); i++) {
+    S z0 = (S) tab.z0(i);
+    auto d = [&](double ph) {
+      return drift(ph, z0, z1, f0, f1, sr, len, t);
+    };
+    std::vector<double> v(scan + 1);
+    for(std::size_t n = 0; n <= scan; n++) v[n] = d(twopi*n/scan);
+    double best = NAN, dist = 1e300;
+    for(std::size_t n = 0; n < scan; n++) {
+      double lo = twopi*n/scan, hi = twopi*(n+1)/scan;
+      if((v[n] < 0) == (v[n+1] < 0)) continue;
+      double vlo = v[n];
+      for(int it = 0; it < 24; it++) {
+        double mid = (lo + hi)/2, vm = d(mid);
+        if((vm < 0) == (vlo < 0)) {
+          lo = mid;
+          vlo = vm;
+        } else hi = mid;
+      }
+      double root = (lo + hi)/2;
+      // nothing to follow: prefer a rising crossing
+      double a = std::isnan(prev) ? (v[n] < 0 ? 0 : 1) :
+        std::fabs(std::remainder(root - prev, twopi));
+      if(a < dist) {
+        dist = a;
+        best = root;
+      }
+    }
+    if(std::isnan(best)) {
+      // no zero crossing: least drift on the scan
+      std::size_t nm = 0;
+      for(std::size_t n = 1; n < scan; n++)
+        if(std::fabs(v[n]) < std::fabs(v[nm])) nm = n;
+      best = twopi*nm/scan;
+    }
+    tab.at(i, j, k, r) = (float) best;
+    if(i == 1) first = best;
+    prev = best;
+  }
+  // z0 = 0 makes no sideband; continue the row
+  tab.at(0, j, k, r) = tab.z0s() > 1 ? tab.at(1, j, k, r) : 0.f;
+  return first;
+}
+
+/**
+   solves the whole table for StackedFM<S> on tables of
+   tsize points at sr, on nt threads
+*/
+template<typename S>
+void solve(Offsets &tab, std::size_t tsize, unsigned int sr,
+           unsigned int nt) {
+  const double secs = .2;
+  auto t = table<S>(tsize);
+  // (z1, ratio) planes are independent: solve them on a
+  // thread pool, each in frequency order
+  std::atomic<std::size_t> next(0);
+  std::size_t planes = tab.z1s()*tab.ratios();
+  std::vector<std::thread> pool;
+  for(unsigned int n = 0; n < (nt ? nt : 1); n++)
+    pool.emplace_back([&] {
+        for(std::size_t w; (w = next++) < planes; ) {
+          double prev = NAN;
+          for(std::size_t k = 0; k < tab.freqs(); k++)
+            prev = row<S>(tab, w % tab.z1s(), k, w / tab.z1s(), prev,
+                          sr, secs, t);
+        }
+      });
+  for(auto &th : pool) th.join();
+}
+
+int main(int argc, const char* argv[]) {
+  if(argc > 3) {
+    double z0max = std::atof(argv[1]), z1max = std::atof(argv[2]);
+    std::size_t nr = std::strtoul(argv[3], nullptr, 10);
+    double fmax = argc > 4 ? std::atof(argv[4]) : 2000;
+    std::string path = argc > 5 ? argv[5] : "offsets.tab";
+    unsigned int nt = argc > 6 ? std::atoi(argv[6]) :
+      std::thread::hardware_concurrency();
+    // the engine to solve for: operator rate, precision
+    // and table size
+    unsigned int sr = argc > 7 ? std::atoi(argv[7]) : 44100;
+    bool dbl = argc > 8 && std::strcmp(argv[8], "double") == 0;
+    std::size_t tsize = argc > 9 ? std::strtoul(argv[9], nullptr, 10) : 1025;
+    if(!sr || tsize < 3 || ((tsize - 1) & (tsize - 2))) {
+      std::cerr << "bad rate or table size (2^k + 1)" << std::endl;
+      return 1;
+    }
+    // fm0 grid in Hz at sr
+    const double dz0 = .25, dz1 = .5, df = 100;
+    Offsets tab((std::size_t) (z0max/dz0) + 1,
+                (std::size_t) (z1max/dz1) + 1,
+                std::max((std::size_t) (fmax/df), (std::size_t) 1),
+                nr, dz0, dz1, df/sr,
+                dbl ? sizeof(double) : sizeof(float), tsize, sr);
+    if(dbl) solve<double>(tab, tsize, sr, nt);
+    else solve<float>(tab, tsize, sr, nt);
+
+    if(!tab.save(path)) {
+      std::cerr << "cannot write " << path << std::endl;
+      return 1;
+    }
+    std::cout << path << std::endl;
+  } else
+    std::cout << "usage: " << argv[0] <<
+      " z0max z1max ratios [fmax(Hz)] [file] [threads] [sr]"
+      " [float|double] [table]" << std::endl;
+  return 0;
+}
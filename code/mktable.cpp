@@ -0,0 +1,45 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include "table.h"
+
+/**
+   writes a precomputed table file, to be mapped by
+   table<S>() when $FM_TABLES points at its directory
+*/
+template<typename S>
+int write(const std::string &dir, std::size_t size, Wave w) {
+  std::string path = dir + "/" + table_file<S>(size, w);
+  std::FILE *fp = std::fopen(path.c_str(), "wb");
+  if(!fp) {
+    std::cerr << "cannot open " << path << std::endl;
+    return 1;
+  }
+  TableHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, "FMTABLE", 8);
+  h.size = size;
+  h.bytes = sizeof(S);
+  h.wave = w;
+  Table<S> t(size, w);
+  std::fwrite(&h, sizeof(h), 1, fp);
+  std::fwrite(t.data(), sizeof(S), size, fp);
+  std::fclose(fp);
+  std::cout << path << std::endl;
+  return 0;
+}
+
+int main(int argc, const char* argv[]) {
+  if(argc > 1) {
+    std::size_t size = std::strtoul(argv[1], nullptr, 10);
+    bool f32 = argc > 2 && std::strcmp(argv[2], "f32") == 0;
+    Wave w = argc > 3 && std::strcmp(argv[3], "sin") == 0 ? SIN : COS;
+    std::string dir = argc > 4 ? argv[4] : ".";
+    return f32 ? write<float>(dir, size, w) : write<double>(dir, size, w);
+  } else
+    std::cout << "usage: " << argv[0] <<
+      " size [f32|f64] [cos|sin] [dir]" << std::endl;
+  return 0;
+}
@@ -0,0 +1,197 @@
+#ifndef OFFSETS_H
+#define OFFSETS_H
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/**
+   Phase offset file header, followed by the offsets
+   (float, radians) at offset 64, z0 fastest, then z1,
+   then fm0/sr, then ratio (see mkoffsets.cpp), and the
+   engine they were solved for: sample size (bytes),
+   table size and sampling rate (0 if unknown, older
+   files)
+*/
+struct OffsetHeader {
+  char magic[8];
+  uint32_t nz0;
+  uint32_t nz1;
+  uint32_t nf;
+  uint32_t nr;
+  double dz0;
+  double dz1;
+  double df;
+  uint32_t sample;
+  uint32_t tab;
+  uint32_t sr;
+  char pad[4];
+};
+
+/**
+   Modulator phase offset table
+   holds, for a grid of z0, z1, normalised zero-level
+   frequency fm0/sr and integer ratios fm1/fm0 = 1 .. nr,
+   the start phase of the zero-level
+   modulator that puts the 0 Hz sideband of the first-level
+   modulation in sine phase, so that the digital integration
+   error does not make the carrier drift (the paper's
+   mitigation 2).
+*/
+class Offsets {
+  std::vector<float> off;
+  std::size_t nz0, nz1, nf, nr;
+  double dz0, dz1, df;
+  std::size_t bytes, tsize;
+  unsigned int rate;
+
+  static double wrap(double a) {
+    return a - 2*M_PI*std::floor(a/(2*M_PI) + .5);
+  }
+
+  // grid cell [i, i1] of x (clamped) and the fraction in it
+  static double cell(double x, std::size_t n, std::size_t &i,
+                     std::size_t &i1) {
+    x = std::fmin(std::fmax(x, 0), n - 1.);
+    i = std::min((std::size_t) x, n > 1 ? n - 2 : 0);
+    i1 = n > 1 ? i + 1 : i;
+    return x - i;
+  }
+
+public:
+  /**
+     std::size_t z0s, z1s: grid points (z = 0, dz, ...)
+     std::size_t freqs: grid points (fm0/sr = df, 2df, ...)
+     std::size_t ratios: integer ratios 1 .. ratios
+     double d0, d1, d: z0, z1 and fm0/sr grid steps
+     std::size_t sbytes: engine sample size (bytes)
+     std::size_t tab: engine table size
+     unsigned int fs: engine sampling rate
+  */
+  Offsets(std::size_t z0s, std::size_t z1s, std::size_t freqs,
+          std::size_t ratios, double d0, double d1, double d,
+          std::size_t sbytes, std::size_t tab, unsigned int fs) :
+    off(z0s*z1s*freqs*ratios), nz0(z0s), nz1(z1s), nf(freqs),
+    nr(ratios), dz0(d0), dz1(d1), df(d), bytes(sbytes), tsize(tab),
+    rate(fs) { };
+
+  /**
+     const std::string &path: offset file
+     leaves size() == 0 if it cannot be read or its grid
+     steps are not positive
+  */
+  Offsets(const std::string &path) :
+    nz0(0), nz1(0), nf(0), nr(0), dz0(0), dz1(0), df(0),
+    bytes(0), tsize(0), rate(0) {
+    std::FILE *fp = std::fopen(path.c_str(), "rb");
+    if(!fp) return;
+    OffsetHeader h;
+    // the lookup divides by the steps (NaN fails too)
+    if(std::fread(&h, sizeof(h), 1, fp) == 1 &&
+       std::memcmp(h.magic, "FMPHASE", 8) == 0 &&
+       h.dz0 > 0 && h.dz1 > 0 && h.df > 0) {
+      std::vector<float> d((std::size_t) h.nz0*h.nz1*h.nf*h.nr);
+      if(std::fread(d.data(), sizeof(float), d.size(), fp) == d.size()) {
+        off.swap(d);
+        nz0 = h.nz0;
+        nz1 = h.nz1;
+        nf = h.nf;
+        nr = h.nr;
+        dz0 = h.dz0;
+        dz1 = h.dz1;
+        df = h.df;
+        bytes = h.sample;
+        tsize = h.tab;
+        rate = h.sr;
+      }
+    }
+    std::fclose(fp);
+  }
+
+  /**
+     writes the table; returns false on failure
+  */
+  bool save(const std::string &path) const {
+    std::FILE *fp = std::fopen(path.c_str(), "wb");
+    if(!fp) return false;
+    OffsetHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "FMPHASE", 8);
+    h.nz0 = nz0;
+    h.nz1 = nz1;
+    h.nf = nf;
+    h.nr = nr;
+    h.dz0 = dz0;
+    h.dz1 = dz1;
+    h.df = df;
+    h.sample = (uint32_t) bytes;
+    h.tab = (uint32_t) tsize;
+    h.sr = rate;
+    bool ok = std::fwrite(&h, sizeof(h), 1, fp) == 1 &&
+      std::fwrite(off.data(), sizeof(float), off.size(), fp) == off.size();
+    return std::fclose(fp) == 0 && ok;
+  }
+
+  std::size_t size() const { return off.size(); }
+  std::size_t z0s() const { return nz0; }
+  std::size_t z1s() const { return nz1; }
+  std::size_t freqs() const { return nf; }
+  std::size_t ratios() const { return nr; }
+  double z0(std::size_t i) const { return i*dz0; }
+  double z1(std::size_t j) const { return j*dz1; }
+  double freq(std::size_t k) const { return (k + 1)*df; }
+  std::size_t sample() const { return bytes; }
+  std::size_t tabsize() const { return tsize; }
+  unsigned int sr() const { return rate; }
+
+  /**
+     returns false if the table was solved for another
+     sample size, table size or sampling rate (true for
+     the ones not recorded)
+  */
+  bool matches(std::size_t sbytes, std::size_t tab, unsigned int fs) const {
+    return (!bytes || bytes == sbytes) && (!tsize || tsize == tab) &&
+      (!rate || rate == fs);
+  }
+
+  float &at(std::size_t i, std::size_t j, std::size_t k, std::size_t r) {
+    return off[((r*nf + k)*nz1 + j)*nz0 + i];
+  }
+  float at(std::size_t i, std::size_t j, std::size_t k,
+           std::size_t r) const {
+    return off[((r*nf + k)*nz1 + j)*nz0 + i];
+  }
+
+  /**
+     returns the zero-level modulator start phase (radians)
+     for indices z0, z1, frequency f = fm0/sr and ratio
+     fm1/fm0, interpolated on the grid; 0 for ratios off
+     the table (non-integer ratios make no 0 Hz sideband)
+  */
+  double operator()(double z0, double z1, double f,
+                    double ratio) const {
+    double q = std::round(ratio);
+    if(off.empty() || q < 1 || q > nr || std::fabs(ratio - q) > 1e-3)
+      return 0;
+    std::size_t r = (std::size_t) q - 1;
+    std::size_t i, j, k, i1, j1, k1;
+    double fx = cell(z0/dz0, nz0, i, i1);
+    double fy = cell(z1/dz1, nz1, j, j1);
+    double fz = cell(f/df - 1, nf, k, k1);
+    // interpolate angles relative to the first corner
+    double a = at(i,j,k,r), v = 0;
+    for(int c = 0; c < 8; c++) {
+      double w = (c & 1 ? fx : 1 - fx)*(c & 2 ? fy : 1 - fy)*
+        (c & 4 ? fz : 1 - fz);
+      v += w*(a + wrap(at(c & 1 ? i1 : i, c & 2 ? j1 : j,
+                          c & 4 ? k1 : k, r) - a));
+    }
+    return v;
+  }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef OP_H
+#define OP_H
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include "table.h"
+#include "sine.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// integer indexing oscillator (32bit)
+// takes sample type, wave evaluation policy (sine.h) and
+// table precision T: the table, its interpolation and the
+// phase increments are computed in T. T = S = float is the
+// fast path (8 lanes with AVX2); T = double is the
+// reference.
+template<typename S, typename W = Linear, typename T = S>
+class Op {
+  static constexpr long maxlen = 0x100000000; 
+  std::shared_ptr<const Table<T>> ref;
+  Lookup<T> lk;
+  std::vector<S> out;
+  std::vector<S> mod;
+  S fdb;
+  unsigned int fs;  
+  unsigned int phs;
+  T fac;
+
+  const std::vector<S> &run(S a,S fr,
+                            const S* fm,S g){
+    process(out.data(),out.size(),a,fr,fm,g,mod.data());
+    return out;
+  }
+
+#if defined(__AVX2__)
+  // four frequencies fr + fm[n..n+3], summed in S
+  static __m256d freq4(S fr,const S *fm){
+    if constexpr (std::is_same<S,float>::value) {
+      __m128 f = _mm_set1_ps(fr);
+      if(fm) f = _mm_add_ps(f,_mm_loadu_ps(fm));
+      return _mm256_cvtps_pd(f);
+    } else {
+      __m256d f = _mm256_set1_pd(fr);
+      return fm ? _mm256_add_pd(f,_mm256_loadu_pd(fm)) : f;
+    }
+  }
+
+  static void store4(S *p,__m256d v){
+    if constexpr (std::is_same<S,float>::value)
+      _mm_storeu_ps(p,_mm256_cvtpd_ps(v));
+    else _mm256_storeu_pd(p,v);
+  }
+
+  // no-feedback path, four frames at a time: the phase
+  // increments are computed together and prefix-summed
+  // in-register (wrapping 32-bit adds), so the wave
+  // evaluation (W::wave4) needs no serial phase chain.
+  // Same arithmetic as step(), frame for frame.
+  // Returns the frames done (a multiple of 4).
+  std::size_t linear(S *dst,std::size_t nframes,S a,S fr,
+                     const S *fm,S *mo,unsigned int &ph,S &fb){
+    const __m256d va = _mm256_set1_pd((double) a);
+    __m128i base = _mm_set1_epi32((int) ph);
+    std::size_t n = 0;
+    for(; n + 4 <= nframes; n += 4) {
+      __m256d f = freq4(fr,fm ? fm + n : nullptr);
+      __m256d w = lanes(f,base);
+      store4(dst + n,_mm256_mul_pd(va,w));
+      __m256d b = _mm256_mul_pd(w,f);
+      if constexpr (std::is_same<S,float>::value) {
+        __m128 bf = _mm256_cvtpd_ps(b);
+        if(mo) _mm_storeu_ps(mo + n,_mm_mul_ps(bf,_mm_set1_ps(a)));
+        fb = _mm_cvtss_f32(_mm_shuffle_ps(bf,bf,0xff));
+      } else {
+        if(mo) _mm256_storeu_pd(mo + n,_mm256_mul_pd(b,va));
+        fb = _mm256_cvtsd_f64(_mm256_permute4x64_pd(b,0xff));
+      }
+    }
+    ph = (unsigned int) _mm_cvtsi128_si32(base);
+    return n;
+  }
+
+  // the same on float tables, eight frames at a time
+  std::size_t linear8(float *dst,std::size_t nframes,float a,float fr,
+                      const float *fm,float *mo,unsigned int &ph,
+                      float &fb){
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256i last = _mm256_set1_epi32(7);
+    __m256i base = _mm256_set1_epi32((int) ph);
+    std::size_t n = 0;
+    for(; n + 8 <= nframes; n += 8) {
+      __m256 f = _mm256_set1_ps(fr);
+      if(fm) f = _mm256_add_ps(f,_mm256_loadu_ps(fm + n));
+      __m256 w = lanes(f,base);
+      _mm256_storeu_ps(dst + n,_mm256_mul_ps(va,w));
+      __m256 b = _mm256_mul_ps(w,f);
+      if(mo) _mm256_storeu_ps(mo + n,_mm256_mul_ps(b,va));
+      fb = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(b,last));
+    }
+    ph = (unsigned int) _mm256_cvtsi256_si32(base);
+    return n;
+  }
+#endif
+
+public:
+#if defined(__AVX2__)
+  // the no-feedback path on caller-held lanes: the waves
+  // at the phases base + the prefix sums of the
+  // increments of frequencies f (four, double tables),
+  // base advanced past them, for linear() and for
+  // kernels that chain several operators in registers
+  __m256d lanes(__m256d f,__m128i &base) const {
+    __m128i inc = _mm256_cvttpd_epi32(_mm256_mul_pd(f,_mm256_set1_pd(fac)));
+    // inclusive prefix sum, then shift to exclusive
+    __m128i sum = _mm_add_epi32(inc,_mm_slli_si128(inc,4));
+    sum = _mm_add_epi32(sum,_mm_slli_si128(sum,8));
+    __m128i p = _mm_add_epi32(base,_mm_sub_epi32(sum,inc));
+    base = _mm_add_epi32(base,_mm_shuffle_epi32(sum,0xff));
+    return W::wave4(lk,p);
+  }
+  // the same, eight frequencies on float tables: the
+  // prefix sum runs in each 128-bit half, then the low
+  // half's total is carried into the high half
+  __m256 lanes(__m256 f,__m256i &base) const {
+    const __m256i last = _mm256_set1_epi32(7);
+    __m256i inc = _mm256_cvttps_epi32(_mm256_mul_ps(f,_mm256_set1_ps(fac)));
+    __m256i sum = _mm256_add_epi32(inc,_mm256_slli_si256(inc,4));
+    sum = _mm256_add_epi32(sum,_mm256_slli_si256(sum,8));
+    __m256i lo = _mm256_shuffle_epi32(sum,0xff);
+    sum = _mm256_add_epi32(sum,_mm256_permute2x128_si256(lo,lo,0x08));
+    __m256i p = _mm256_add_epi32(base,_mm256_sub_epi32(sum,inc));
+    base = _mm256_add_epi32(base,_mm256_permutevar8x32_epi32(sum,last));
+    return W::wave8(lk,p);
+  }
+#endif
+
+private:
+  void init(const T *tab,std::size_t len){
+    unsigned int lobits = 0;
+    for(unsigned long t = len-1; 
+        (t & maxlen) == 0; t <<= 1) lobits += 1;
+    lk.tab = tab;
+    lk.lobits = lobits;
+    lk.lomask = (1 << lobits) - 1;
+    lk.mask = (unsigned int) len - 2;
+    lk.nfac = (T) (1./(lk.lomask + 1));
+  }
+
+public:
+  Op(const std::vector<T> &table, unsigned int sr, 
+     std::size_t vsize) :
+    out(vsize),mod(vsize),fdb(0),fs(sr),
+    phs(0),fac((T) ((double) maxlen/sr)){
+    init(table.data(),table.size());
+  }
+
+  // shares a registry table (default: 1025-point cosine)
+  Op(unsigned int sr, std::size_t vsize,
+     std::shared_ptr<const Table<T>> table = ::table<T>()) :
+    ref(table),out(vsize),mod(vsize),fdb(0),
+    fs(sr),phs(0),fac((T) ((double) maxlen/sr)){
+    init(ref->data(),ref->size());
+  }
+
+  unsigned int vsize(){return out.size();}
+  unsigned int sr(){return fs;}
+  const S *data(){return out.data();}
+
+  // instantaneous frequency
+  static S freq(S fr,S fb,S g,S fm){return fr+fb*g+fm;}
+
+  // wave at phase ph (policy W)
+  T wave(unsigned int ph) const {return W::wave(lk,ph);}
+
+  // one sample on caller-held phase and feedback state,
+  // for kernels that keep several operators in registers
+  S step(S a,S f,unsigned int &ph,S &fb,S &m) const {
+    auto s = wave(ph);
+    ph += (int)(f*fac); 
+    m = (S) ((fb = s*f)*a);
+    return (S) (a*s);
+  }
+  // one sample of phase modulation on caller-held phase:
+  // a times the wave at ph offset by p radians, then ph
+  // advances at the constant frequency f, so modulation
+  // never accumulates into the phase
+  S pm(S a,S f,S p,unsigned int &ph) const {
+    const double rad = maxlen/(2*M_PI);
+    auto s = wave(ph + (unsigned int) (long long) (p*rad));
+    ph += (int)(f*fac);
+    return (S) (a*s);
+  }
+  // renders nframes (any number) into dst, with optional
+  // frequency modulation input fm and modulation output
+  // mo (nframes each), leaving out and mod untouched
+  void process(S *dst,std::size_t nframes,S a,S fr,
+               const S *fm = nullptr,S g = 0,S *mo = nullptr){
+    unsigned int ph = phs;
+    S fb = fdb, m;
+    std::size_t n = 0;
+#if defined(__AVX2__)
+    if constexpr (std::is_same<T,float>::value) {
+      if constexpr (std::is_same<S,float>::value)
+        if(g == 0) n = linear8(dst,nframes,a,fr,fm,mo,ph,fb);
+    } else if(g == 0) n = linear(dst,nframes,a,fr,fm,mo,ph,fb);
+#endif
+    for(; n < nframes; n++)
+      dst[n] = step(a,freq(fr,fb,g,fm?fm[n]:0),ph,fb,mo?mo[n]:m);
+    phs = ph;
+    fdb = fb;
+  }
+  // note start: phase set to ph radians, feedback cleared
+  void reset(double ph = 0){
+    phs = (unsigned int) (long long) std::floor(ph*maxlen/(2*M_PI));
+    fdb = 0;
+  }
+  void load(unsigned int &ph,S &fb){ph = phs; fb = fdb;}
+  void store(unsigned int ph,S fb){phs = ph; fdb = fb;}
+  
+  const std::vector<S> &operator()(){return mod;}
+  const std::vector<S> &operator()(S a,S fr,S g=0){
+    return run(a,fr,nullptr,g);
+  }
+  const std::vector<S> &operator()(S a, S fr,
+                                   const std::vector<S> &fm,
+                                   S g = 0) {
+    return run(a,fr,fm.data(),g);
+  }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef OPBANK_H
+#define OPBANK_H
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include <memory>
+#include "table.h"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+   Operator bank template class
+   takes sample type and number of voices.
+   Runs N copies of the feedback operator (fm_v7 Op) in
+   lockstep, keeping phase, feedback, frequency and
+   amplitude in struct-of-arrays form so that each voice
+   is one SIMD lane. Signals are interleaved by voice,
+   sig[n*N + v].
+*/
+template<typename S, std::size_t N>
+class OpBank {
+  static constexpr long maxlen = 0x100000000;
+  std::shared_ptr<const Table<S>> tab;
+  std::vector<S> out;
+  std::vector<S> mod;
+  std::vector<S> sum;
+  alignas(64) S fdb[N];
+  alignas(64) S amp[N];
+  alignas(64) S frq[N];
+  alignas(64) S gn[N];
+  alignas(64) unsigned int phs[N];
+  unsigned int fs;
+  unsigned int lobits;
+  unsigned int lomask;
+  S fac;
+  S nfac;
+
+  // one sample for voices [v, v+L), generic lanes
+  void lanes(std::size_t v, std::size_t L, std::size_t n,
+             const S *fm) {
+    for(std::size_t k = v; k < v + L; k++) {
+      S f = frq[k] + fdb[k]*gn[k] + (fm ? fm[n*N+k] : 0);
+      unsigned int ndx = phs[k] >> lobits;
+      const S *t = tab->data();
+      S s = t[ndx] + nfac*(phs[k] & lomask)*(t[ndx+1] - t[ndx]);
+      phs[k] += (int) (f*fac);
+      fdb[k] = s*f;
+      mod[n*N+k] = fdb[k]*amp[k];
+      out[n*N+k] = amp[k]*s;
+    }
+  }
+
+#if defined(__AVX512F__)
+  void lanes16(std::size_t v, std::size_t n, const S *fm) {
+    const float *t = tab->data();
+    __m512 f = _mm512_add_ps(_mm512_load_ps(frq+v),
+                  _mm512_mul_ps(_mm512_load_ps(fdb+v),
+                                _mm512_load_ps(gn+v)));
+    if(fm) f = _mm512_add_ps(f, _mm512_loadu_ps(fm+n*N+v));
+    __m512i ph = _mm512_load_si512((const void *) (phs+v));
+    __m512i ndx = _mm512_srli_epi32(ph, lobits);
+    __m512 frac = _mm512_mul_ps(_mm512_set1_ps(nfac),
+                    _mm512_cvtepu32_ps(_mm512_and_si512(ph,
+                       _mm512_set1_epi32(lomask))));
+    // masked gathers from a zeroed source (the unmasked
+    // forms leave it undefined)
+    const __m512 z = _mm512_setzero_ps();
+    __m512 s0 = _mm512_mask_i32gather_ps(z, 0xffff, ndx, t, 4);
+    __m512 s1 = _mm512_mask_i32gather_ps(z, 0xffff, _mm512_add_epi32(ndx,
+                    _mm512_set1_epi32(1)), t, 4);
+    __m512 s = _mm512_add_ps(s0, _mm512_mul_ps(frac,
+                                  _mm512_sub_ps(s1, s0)));
+    ph = _mm512_add_epi32(ph, _mm512_cvttps_epi32(
+                     _mm512_mul_ps(f, _mm512_set1_ps(fac))));
+    _mm512_store_si512((void *) (phs+v), ph);
+    __m512 fb = _mm512_mul_ps(s, f);
+    __m512 a = _mm512_load_ps(amp+v);
+    _mm512_store_ps(fdb+v, fb);
+    _mm512_storeu_ps(&mod[n*N+v], _mm512_mul_ps(fb, a));
+    _mm512_storeu_ps(&out[n*N+v], _mm512_mul_ps(a, s));
+  }
+#endif
+
+#if defined(__AVX2__)
+  void lanes8(std::size_t v, std::size_t n, const S *fm) {
+    const float *t = tab->data();
+    __m256 f = _mm256_add_ps(_mm256_load_ps(frq+v),
+                  _mm256_mul_ps(_mm256_load_ps(fdb+v),
+                                _mm256_load_ps(gn+v)));
+    if(fm) f = _mm256_add_ps(f, _mm256_loadu_ps(fm+n*N+v));
+    __m256i ph = _mm256_load_si256((const __m256i *) (phs+v));
+    __m256i ndx = _mm256_srli_epi32(ph, lobits);
+    // low bits < 2^31, so the signed conversion is exact
+    __m256 frac = _mm256_mul_ps(_mm256_set1_ps(nfac),
+                    _mm256_cvtepi32_ps(_mm256_and_si256(ph,
+                       _mm256_set1_epi32(lomask))));
+    const __m256 z = _mm256_setzero_ps(),
+      all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 s0 = _mm256_mask_i32gather_ps(z, t, ndx, all, 4);
+    __m256 s1 = _mm256_mask_i32gather_ps(z, t, _mm256_add_epi32(ndx,
+                    _mm256_set1_epi32(1)), all, 4);
+    __m256 s = _mm256_add_ps(s0, _mm256_mul_ps(frac,
+                                  _mm256_sub_ps(s1, s0)));
+    ph = _mm256_add_epi32(ph, _mm256_cvttps_epi32(
+                     _mm256_mul_ps(f, _mm256_set1_ps(fac))));
+    _mm256_store_si256((__m256i *) (phs+v), ph);
+    __m256 fb = _mm256_mul_ps(s, f);
+    __m256 a = _mm256_load_ps(amp+v);
+    _mm256_store_ps(fdb+v, fb);
+    _mm256_storeu_ps(&mod[n*N+v], _mm256_mul_ps(fb, a));
+    _mm256_storeu_ps(&out[n*N+v], _mm256_mul_ps(a, s));
+  }
+#endif
+
+  const std::vector<S> &process(const S *fm) {
+    std::size_t vs = vsize();
+    for(std::size_t n = 0; n < vs; n++) {
+      std::size_t v = 0;
+      if constexpr (std::is_same<S,float>::value) {
+#if defined(__AVX512F__)
+        for(; v + 16 <= N; v += 16) lanes16(v, n, fm);
+#endif
+#if defined(__AVX2__)
+        for(; v + 8 <= N; v += 8) lanes8(v, n, fm);
+#endif
+      }
+      lanes(v, N - v, n, fm);
+    }
+    return out;
+  }
+
+public:
+  /**
+     unsigned int sr: sampling rate
+     std::size_t vsize: signal vector size (frames)
+     table: wave table (size 2^n + 1)
+  */
+  OpBank(unsigned int sr, std::size_t vsize,
+         std::shared_ptr<const Table<S>> table = ::table<S>()) :
+    tab(table), out(vsize*N), mod(vsize*N), sum(vsize), fs(sr),
+    lobits(0), fac((S) ((double) maxlen/sr)) {
+    for(unsigned long t = tab->size()-1;
+        (t & maxlen) == 0; t <<= 1) lobits += 1;
+    lomask = (1 << lobits) - 1;
+    nfac = (S) (1./(lomask + 1));
+    for(std::size_t v = 0; v < N; v++) {
+      fdb[v] = amp[v] = frq[v] = gn[v] = 0;
+      phs[v] = 0;
+    }
+  }
+
+  std::size_t vsize() { return sum.size(); }
+  static constexpr std::size_t voices() { return N; }
+  unsigned int sr() { return fs; }
+  const S *data() { return out.data(); }
+
+  /**
+     std::size_t v: voice
+     S a: amplitude
+     S fr: frequency
+     S g: feedback gain
+  */
+  void set(std::size_t v, S a, S fr, S g = 0) {
+    amp[v] = a;
+    frq[v] = fr;
+    gn[v] = g;
+  }
+
+  /**
+     std::size_t v: voice
+     resets the voice phase and feedback state
+  */
+  void reset(std::size_t v) {
+    phs[v] = 0;
+    fdb[v] = 0;
+  }
+
+  /**
+     returns the (voice-interleaved) modulation signal
+  */
+  const std::vector<S> &operator()() { return mod; }
+
+  /**
+     returns the sum of all voices
+  */
+  const std::vector<S> &mix() {
+    std::size_t n = 0;
+    for(auto &s : sum) {
+      s = 0;
+      for(std::size_t v = 0; v < N; v++) s += out[n*N+v];
+      n++;
+    }
+    return sum;
+  }
+
+  /**
+     synthesis without modulation input
+     returns the (voice-interleaved) output signal
+  */
+  const std::vector<S> &synth() { return process(nullptr); }
+
+  /**
+     const std::vector<S> &fm: (voice-interleaved)
+     frequency modulation, e.g. another bank's mod
+  */
+  const std::vector<S> &operator()(const std::vector<S> &fm) {
+    return process(fm.data());
+  }
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef OPGRAPH_H
+#define OPGRAPH_H
+#include <vector>
+#include <cstddef>
+#include <memory>
+#include "op.h"
+
+/**
+   Operator graph template class
+   takes sample type.
+   Builds DX-style algorithms from Op nodes and modulation
+   edges. compile() sorts the graph topologically into a
+   flat schedule and assigns modulation buffers from a
+   preallocated pool by liveness, so each node (shared
+   modulators included) is computed once per block.
+   For modulators the node amplitude is the modulation
+   index; carriers are summed into the output.
+*/
+template<typename S>
+class OpGraph {
+  struct Node {
+    S amp, fr, g;
+    bool car;
+    std::vector<std::size_t> dst;  // nodes modulated by this one
+    std::vector<std::size_t> src;  // nodes modulating this one
+  };
+
+  struct Step {
+    std::size_t node;
+    std::vector<int> in;  // input mod buffers
+    int sum;              // buffer for summed inputs, -1 if none
+    int mod;              // mod output buffer, -1 if unused
+  };
+
+  std::shared_ptr<const Table<S>> tab;
+  unsigned int fs;
+  std::size_t vs;
+  std::vector<Op<S>> ops;
+  std::vector<Node> nodes;
+  std::vector<Step> sched;
+  std::vector<std::vector<S>> pool;
+  std::vector<S> out;
+
+  // take a free pool buffer, growing the pool if needed
+  static int take(std::vector<bool> &busy) {
+    for(std::size_t b = 0; b < busy.size(); b++)
+      if(!busy[b]) {
+        busy[b] = true;
+        return (int) b;
+      }
+    busy.push_back(true);
+    return (int) busy.size() - 1;
+  }
+
+public:
+  /**
+     unsigned int sr: sampling rate
+     std::size_t vsize: signal vector size
+     table: wave table shared by all nodes
+  */
+  OpGraph(unsigned int sr, std::size_t vsize,
+          std::shared_ptr<const Table<S>> table =
+          ::table<S>()) :
+    tab(table), fs(sr), vs(vsize), out(vsize) { };
+
+  unsigned int vsize() { return out.size(); }
+  unsigned int sr() { return fs; }
+  const S *data() { return out.data(); }
+
+  /**
+     adds an operator node
+     S a: amplitude (carrier) or index (modulator)
+     S fr: frequency
+     S g: feedback gain
+     bool carrier: node is summed into the output
+     returns the node id
+  */
+  std::size_t add(S a, S fr, S g = 0, bool carrier = false) {
+    nodes.push_back({a, fr, g, carrier, {}, {}});
+    ops.emplace_back(fs, vs, tab);
+    return nodes.size() - 1;
+  }
+
+  /**
+     std::size_t from: modulating node
+     std::size_t to: modulated node
+  */
+  void connect(std::size_t from, std::size_t to) {
+    nodes[from].dst.push_back(to);
+    nodes[to].src.push_back(from);
+  }
+
+  /**
+     sets node parameters
+  */
+  void set(std::size_t k, S a, S fr, S g = 0) {
+    nodes[k].amp = a;
+    nodes[k].fr = fr;
+    nodes[k].g = g;
+  }
+
+  /**
+     builds the schedule; returns false if the graph has
+     a cycle (feedback is only per node, through g)
+  */
+  bool compile() {
+    std::size_t nn = nodes.size();
+    std::vector<std::size_t> order, deg(nn);
+    for(std::size_t k = 0; k < nn; k++) {
+      deg[k] = nodes[k].src.size();
+      if(deg[k] == 0) order.push_back(k);
+    }
+    for(std::size_t i = 0; i < order.size(); i++)
+      for(auto d : nodes[order[i]].dst)
+        if(--deg[d] == 0) order.push_back(d);
+    if(order.size() != nn) return false;
+
+    // last step that reads each node's mod output
+    std::vector<std::size_t> pos(nn), last(nn, 0);
+    for(std::size_t i = 0; i < nn; i++) pos[order[i]] = i;
+    for(std::size_t k = 0; k < nn; k++)
+      for(auto d : nodes[k].dst)
+        if(pos[d] > last[k]) last[k] = pos[d];
+
+    std::vector<int> buf(nn, -1);
+    std::vector<bool> busy;
+    sched.clear();
+    for(std::size_t i = 0; i < nn; i++) {
+      std::size_t k = order[i];
+      Step st{k, {}, -1, -1};
+      for(auto s : nodes[k].src) st.in.push_back(buf[s]);
+      if(st.in.size() > 1) st.sum = take(busy);
+      if(!nodes[k].dst.empty()) st.mod = buf[k] = take(busy);
+      if(st.sum >= 0) busy[st.sum] = false;
+      for(auto s : nodes[k].src)
+        if(last[s] == i) busy[buf[s]] = false;
+      sched.push_back(st);
+    }
+    pool.assign(busy.size(), std::vector<S>(vs));
+    return true;
+  }
+
+  /**
+     returns the number of pooled modulation buffers
+  */
+  std::size_t buffers() { return pool.size(); }
+
+  /**
+     audio synthesis method
+     runs the compiled schedule for one block
+     returns the summed carrier output
+  */
+  const std::vector<S> &operator()() {
+    for(auto &o : out) o = 0;
+    for(auto &st : sched) {
+      Node &nd = nodes[st.node];
+      Op<S> &op = ops[st.node];
+      const S *in = nullptr;
+      if(st.sum >= 0) {
+        S *sum = pool[st.sum].data();
+        for(std::size_t n = 0; n < vs; n++) sum[n] = 0;
+        for(auto b : st.in)
+          for(std::size_t n = 0; n < vs; n++) sum[n] += pool[b][n];
+        in = sum;
+      } else if(!st.in.empty()) in = pool[st.in[0]].data();
+      S *mod = st.mod >= 0 ? pool[st.mod].data() : nullptr;
+      unsigned int ph;
+      S fb, m;
+      op.load(ph, fb);
+      for(std::size_t n = 0; n < vs; n++) {
+        S o = op.step(nd.amp, Op<S>::freq(nd.fr, fb, nd.g,
+                                          in ? in[n] : 0), ph, fb, m);
+        if(mod) mod[n] = m;
+        if(nd.car) out[n] += o;
+      }
+      op.store(ph, fb);
+    }
+    return out;
+  }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+
+/**
+   Sample output class
+   writes whole signal vectors to a stream, either as
+   text (one sample per line, for debugging and towav)
+   or as raw little-endian float32 / int16 samples;
+   writes nothing for an unknown format (ok() false)
+*/
+class Output {
+public:
+  enum Format { TEXT, F32, S16, NONE };
+
+private:
+  std::FILE *fp;
+  Format fmt;
+  std::vector<char> buf;
+
+  static bool bigendian() {
+    const uint16_t one = 1;
+    return *((const char *) &one) == 0;
+  }
+
+  template<typename T>
+  static void put(char *dst, T v) {
+    std::memcpy(dst, &v, sizeof(T));
+    if(bigendian())
+      for(std::size_t i = 0; i < sizeof(T)/2; i++)
+        std::swap(dst[i], dst[sizeof(T)-1-i]);
+  }
+
+  static int16_t tos16(float s) {
+    s = s > 1.f ? 1.f : (s < -1.f ? -1.f : s);
+    return (int16_t) (s < 0 ? s*32767.f - .5f : s*32767.f + .5f);
+  }
+
+public:
+  /**
+     returns the format named by fname:
+     "txt", "f32" or "s16" (NONE if unknown)
+  */
+  static Format format(const char *fname) {
+    if(std::strcmp(fname, "txt") == 0) return TEXT;
+    if(std::strcmp(fname, "f32") == 0) return F32;
+    if(std::strcmp(fname, "s16") == 0) return S16;
+    return NONE;
+  }
+
+  /**
+     Format f: output format
+     std::FILE *stream: output stream
+  */
+  Output(Format f = TEXT, std::FILE *stream = stdout) :
+    fp(stream), fmt(f) {
+    std::setvbuf(fp, nullptr, _IOFBF, 1 << 16);
+  };
+
+  ~Output() { std::fflush(fp); }
+
+  /**
+     returns false if the format is unknown (NONE)
+  */
+  bool ok() const { return fmt != NONE; }
+
+  /**
+     const S *sig: signal
+     std::size_t n: number of samples
+  */
+  template<typename S>
+  void operator()(const S *sig, std::size_t n) {
+    switch(fmt) {
+    case F32:
+      buf.resize(n*sizeof(float));
+      for(std::size_t i = 0; i < n; i++)
+        put(&buf[i*sizeof(float)], (float) sig[i]);
+      std::fwrite(buf.data(), 1, buf.size(), fp);
+      break;
+    case S16:
+      buf.resize(n*sizeof(int16_t));
+      for(std::size_t i = 0; i < n; i++)
+        put(&buf[i*sizeof(int16_t)], tos16((float) sig[i]));
+      std::fwrite(buf.data(), 1, buf.size(), fp);
+      break;
+    case TEXT:
+      for(std::size_t i = 0; i < n; i++)
+        std::fprintf(fp, "%g\n", (double) sig[i]);
+      break;
+    default:
+      break;
+    }
+  }
+
+  /**
+     const std::vector<S> &sig: signal vector
+  */
+  template<typename S>
+  void operator()(const std::vector<S> &sig) {
+    (*this)(sig.data(), sig.size());
+  }
+};
+
+#endif
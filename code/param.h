@@ -0,0 +1,121 @@
+#ifndef PARAM_H
+#define PARAM_H
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+/**
+   Parameter ramp template class
+   takes sample type; a linear or exponential segment
+   from one value to another over a render call (see
+   StackedFM::process() in fm_v7.cpp), like Csound's
+   linseg/expseg between block endpoints. Exponential
+   ramps need end points of the same sign, and fall
+   back to linear otherwise.
+*/
+template<typename S> struct Ramp {
+  enum Shape { LIN, EXP };
+  S from, to;
+  Shape shape;
+
+  // value at fraction t of the segment
+  S at(double t) const {
+    if(shape == EXP && from*to > 0)
+      return (S) (from*std::pow((double) to/from, t));
+    return (S) (from + (to - from)*t);
+  }
+};
+
+template<typename S> Ramp<S> line(S from, S to) {
+  return {from, to, Ramp<S>::LIN};
+}
+
+template<typename S> Ramp<S> expon(S from, S to) {
+  return {from, to, Ramp<S>::EXP};
+}
+
+/**
+   parameter inputs: a static value S, a span const S*
+   (audio rate, one value per frame) or a Ramp<S>.
+   Kernels only ever see S or const S*, read with at().
+*/
+template<typename S> inline S at(S v, std::size_t) { return v; }
+template<typename S> inline S at(const S *p, std::size_t n) {
+  return p[n];
+}
+
+// frames off .. off+len of an input spanning total frames
+template<typename S> inline S slice(S v, std::size_t, std::size_t,
+                                    std::size_t) { return v; }
+template<typename S> inline const S *slice(const S *p, std::size_t off,
+                                           std::size_t, std::size_t) {
+  return p + off;
+}
+template<typename S> inline const S *slice(S *p, std::size_t off,
+                                           std::size_t, std::size_t) {
+  return p + off;
+}
+template<typename S> inline Ramp<S> slice(const Ramp<S> &r, std::size_t off,
+                                          std::size_t len,
+                                          std::size_t total) {
+  return {r.at((double) off/total), r.at((double) (off + len)/total),
+          r.shape};
+}
+
+// largest magnitude over len frames
+template<typename S> inline S peak(S v, std::size_t) { return std::fabs(v); }
+template<typename S> inline S peak(const S *p, std::size_t len) {
+  S m = 0;
+  for(std::size_t n = 0; n < len; n++) m = std::max(m, (S) std::fabs(p[n]));
+  return m;
+}
+template<typename S> inline S peak(const Ramp<S> &r, std::size_t) {
+  return std::max(std::fabs(r.from), std::fabs(r.to));
+}
+
+/**
+   expands an input over n frames into len = n*k samples
+   (k samples per frame) scaled by g, as a kernel sees it:
+   static values are just scaled, spans are held k times
+   (passed through when k = 1 and g = 1), ramps are
+   generated at len points, ending just short of r.to,
+   in loops that vectorise. S *buf: len samples of scratch
+*/
+template<typename S> inline S expand(S v, S g, S *, std::size_t,
+                                     std::size_t) { return v*g; }
+
+template<typename S> inline const S *expand(const S *p, S g, S *buf,
+                                            std::size_t n,
+                                            std::size_t k) {
+  if(k == 1 && g == 1) return p;
+  for(std::size_t i = 0; i < n; i++) {
+    S v = p[i]*g;
+    for(std::size_t j = 0; j < k; j++) buf[i*k + j] = v;
+  }
+  return buf;
+}
+
+template<typename S> inline const S *expand(const Ramp<S> &r, S g, S *buf,
+                                            std::size_t n,
+                                            std::size_t k) {
+  std::size_t len = n*k;
+  if(r.shape == Ramp<S>::EXP && r.from*r.to > 0) {
+    // powers of the ratio in blocks of 8, one multiply per
+    // block to advance
+    const std::size_t W = 8;
+    double q = std::pow((double) r.to/r.from, 1./len);
+    S pw[W], base = r.from*g, step = (S) std::pow(q, (double) W);
+    for(std::size_t j = 0; j < W; j++) pw[j] = (S) std::pow(q, (double) j);
+    std::size_t i = 0;
+    for(; i + W <= len; i += W, base *= step)
+      for(std::size_t j = 0; j < W; j++) buf[i + j] = base*pw[j];
+    for(std::size_t j = 0; i < len; i++, j++) buf[i] = base*pw[j];
+  } else {
+    S a = r.from*g, d = (r.to - r.from)*g/len;
+    for(std::size_t i = 0; i < len; i++) buf[i] = a + d*i;
+  }
+  return buf;
+}
+
+#endif
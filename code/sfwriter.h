@@ -0,0 +1,178 @@
+#ifndef SFWRITER_H
+#define SFWRITER_H
+#include <sndfile.h>
+#include <vector>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/**
+   Soundfile writer class
+   streams signal blocks to a WAV or FLAC file through
+   libsndfile from a background thread. Blocks are copied
+   into a bounded queue of preallocated buffers, so the
+   synthesis thread only waits if the disk falls behind
+   by more than the whole queue. Samples libsndfile did
+   not take (short writes) are counted and reported by
+   ok() and error().
+*/
+class SndWriter {
+  SNDFILE *fp;
+  SF_INFO info;
+  std::vector<std::vector<float>> blocks;
+  std::vector<std::size_t> sizes;
+  std::size_t rd, wr, cnt, fill;
+  bool done;
+  std::atomic<std::size_t> lost;  // samples not written
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread thrd;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true) {
+      cv.wait(lock, [this]{ return cnt > 0 || done; });
+      if(cnt == 0) break;
+      const float *b = blocks[rd].data();
+      std::size_t n = sizes[rd];
+      lock.unlock();
+      sf_count_t w = sf_write_float(fp, b, (sf_count_t) n);
+      if(w < (sf_count_t) n) lost += n - (w > 0 ? (std::size_t) w : 0);
+      lock.lock();
+      rd = (rd + 1) % blocks.size();
+      cnt--;
+      cv.notify_all();
+    }
+  }
+
+  // hand the block being filled over to the writer thread
+  void push() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      sizes[wr] = fill;
+      wr = (wr + 1) % blocks.size();
+      cnt++;
+    }
+    fill = 0;
+    cv.notify_all();
+  }
+
+  // queue block size, rounded up to whole frames
+  static std::size_t frames(std::size_t bsize, int chans) {
+    std::size_t c = chans > 1 ? (std::size_t) chans : 1;
+    return bsize ? (bsize + c - 1)/c*c : c;
+  }
+
+public:
+  /**
+     returns the libsndfile format for a file name:
+     .wav (float) or .flac (24-bit), 0 if neither
+  */
+  static int format(const char *name) {
+    std::size_t len = std::strlen(name);
+    if(len > 4 && std::strcmp(name + len - 4, ".wav") == 0)
+      return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    if(len > 5 && std::strcmp(name + len - 5, ".flac") == 0)
+      return SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+    return 0;
+  }
+
+  /**
+     const char *name: output file name
+     int sr: sampling rate
+     int chans: number of channels
+     std::size_t bsize: queue block size (samples, rounded
+     up to a multiple of chans)
+     std::size_t nblocks: queue length (blocks)
+     int fmt: libsndfile format (0 uses the file extension)
+  */
+  SndWriter(const char *name, int sr, int chans = 1,
+            std::size_t bsize = 4096, std::size_t nblocks = 32,
+            int fmt = 0) :
+    fp(nullptr), info(),
+    blocks(nblocks, std::vector<float>(frames(bsize, chans))),
+    sizes(nblocks), rd(0), wr(0), cnt(0), fill(0), done(false), lost(0) {
+    info.samplerate = sr;
+    info.channels = chans;
+    info.format = fmt ? fmt : format(name);
+    fp = sf_open(name, SFM_WRITE, &info);
+    if(fp) thrd = std::thread(&SndWriter::run, this);
+  }
+
+  ~SndWriter() {
+    if(fp) {
+      flush();
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        done = true;
+      }
+      cv.notify_all();
+      thrd.join();
+      sf_close(fp);
+    }
+  }
+
+  /**
+     returns false if the file could not be opened or a
+     write fell short (see flush())
+  */
+  bool ok() { return fp != nullptr && lost == 0; }
+
+  /**
+     returns the samples libsndfile did not write so far
+  */
+  std::size_t dropped() { return lost; }
+
+  /**
+     returns the error message: the libsndfile one, or a
+     short write
+  */
+  const char *error() {
+    return fp && lost ? "short write to the sound file" : sf_strerror(fp);
+  }
+
+  /**
+     writes out all the samples given so far, waiting for
+     the writer thread; returns ok()
+  */
+  bool flush() {
+    if(fp) {
+      if(fill > 0) push();
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this]{ return cnt == 0; });
+    }
+    return ok();
+  }
+
+  /**
+     const float *sig: signal (interleaved if multichannel)
+     std::size_t n: number of samples
+  */
+  void operator()(const float *sig, std::size_t n) {
+    if(!fp) return;
+    while(n > 0) {
+      if(fill == 0) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]{ return cnt < blocks.size(); });
+      }
+      std::size_t k = blocks[wr].size() - fill;
+      if(k > n) k = n;
+      std::memcpy(blocks[wr].data() + fill, sig, k*sizeof(float));
+      fill += k;
+      if(fill == blocks[wr].size()) push();
+      sig += k;
+      n -= k;
+    }
+  }
+
+  /**
+     const std::vector<float> &sig: signal vector
+  */
+  void operator()(const std::vector<float> &sig) {
+    (*this)(sig.data(), sig.size());
+  }
+};
+
+#endif
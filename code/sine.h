@@ -0,0 +1,234 @@
+#ifndef SINE_H
+#define SINE_H
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+   Wave evaluation policies for Op (op.h): the waveform
+   at a 32-bit phase ph (a full cycle over 2^32), as
+   wave(lookup, ph) in the table precision T and, with
+   AVX2, several phases at a time: wave4(lookup, ph) for
+   double tables, wave8(lookup, ph) for float ones.
+   Truncate, Linear and Cubic read the operator's table;
+   Cosine and Minimax compute a cosine and ignore it (use
+   them with cosine tables only).
+*/
+
+// an operator's table, as its policy sees it
+template<typename T> struct Lookup {
+  const T *tab;         // 2^k + 1 points (guard point)
+  unsigned int lobits;  // 32 - k, phase bits below the index
+  unsigned int lomask;  // 2^lobits - 1
+  unsigned int mask;    // 2^k - 1, index wrap
+  T nfac;               // 2^-lobits
+};
+
+#if defined(__AVX2__)
+// table gathers, 4 doubles or 8 floats at 32-bit indices;
+// masked with a zeroed source, as the unmasked forms leave
+// their source undefined (GCC warns under -Wall)
+inline __m256d gather4(const double *tab, __m128i ndx) {
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(),tab,ndx,
+                                  _mm256_castsi256_pd(
+                                    _mm256_set1_epi64x(-1)),8);
+}
+
+inline __m256 gather8(const float *tab, __m256i ndx) {
+  return _mm256_mask_i32gather_ps(_mm256_setzero_ps(),tab,ndx,
+                                  _mm256_castsi256_ps(
+                                    _mm256_set1_epi32(-1)),4);
+}
+#endif
+
+// std::cos in double, the reference
+struct Cosine {
+  template<typename T>
+  static T wave(const Lookup<T> &, unsigned int ph) {
+    return (T) std::cos(ph*(2*M_PI/4294967296.));
+  }
+#if defined(__AVX2__)
+  static __m256d wave4(const Lookup<double> &t, __m128i ph) {
+    alignas(16) unsigned int p[4];
+    _mm_store_si128((__m128i *) p,ph);
+    return _mm256_setr_pd(wave(t,p[0]),wave(t,p[1]),
+                          wave(t,p[2]),wave(t,p[3]));
+  }
+  static __m256 wave8(const Lookup<float> &t, __m256i ph) {
+    alignas(32) unsigned int p[8];
+    alignas(32) float s[8];
+    _mm256_store_si256((__m256i *) p,ph);
+    for(int k = 0; k < 8; k++) s[k] = wave(t,p[k]);
+    return _mm256_load_ps(s);
+  }
+#endif
+};
+
+// table, truncated index
+struct Truncate {
+  template<typename T>
+  static T wave(const Lookup<T> &t, unsigned int ph) {
+    return t.tab[ph >> t.lobits];
+  }
+#if defined(__AVX2__)
+  static __m256d wave4(const Lookup<double> &t, __m128i ph) {
+    return gather4(t.tab,_mm_srli_epi32(ph,(int) t.lobits));
+  }
+  static __m256 wave8(const Lookup<float> &t, __m256i ph) {
+    return gather8(t.tab,_mm256_srli_epi32(ph,(int) t.lobits));
+  }
+#endif
+};
+
+// table, linear interpolation
+struct Linear {
+  template<typename T>
+  static T wave(const Lookup<T> &t, unsigned int ph) {
+    unsigned int ndx = ph >> t.lobits;
+    return t.tab[ndx] +
+      t.nfac*(ph & t.lomask)*(t.tab[ndx+1] - t.tab[ndx]);
+  }
+#if defined(__AVX2__)
+  static __m256d wave4(const Lookup<double> &t, __m128i ph) {
+    __m128i ndx = _mm_srli_epi32(ph,(int) t.lobits);
+    // low bits < 2^31, so the signed conversion is exact
+    __m256d frac = _mm256_cvtepi32_pd(_mm_and_si128(ph,
+                                        _mm_set1_epi32((int) t.lomask)));
+    __m256d t0 = gather4(t.tab,ndx);
+    __m256d t1 = gather4(t.tab,_mm_add_epi32(ndx,_mm_set1_epi32(1)));
+    return _mm256_add_pd(t0,_mm256_mul_pd(_mm256_mul_pd(
+                                            _mm256_set1_pd(t.nfac),frac),
+                                          _mm256_sub_pd(t1,t0)));
+  }
+  static __m256 wave8(const Lookup<float> &t, __m256i ph) {
+    __m256i ndx = _mm256_srli_epi32(ph,(int) t.lobits);
+    __m256 frac = _mm256_cvtepi32_ps(_mm256_and_si256(ph,
+                                       _mm256_set1_epi32((int) t.lomask)));
+    __m256 t0 = gather8(t.tab,ndx);
+    __m256 t1 = gather8(t.tab,_mm256_add_epi32(ndx,_mm256_set1_epi32(1)));
+    return _mm256_add_ps(t0,_mm256_mul_ps(_mm256_mul_ps(
+                                            _mm256_set1_ps(t.nfac),frac),
+                                          _mm256_sub_ps(t1,t0)));
+  }
+#endif
+};
+
+// table, 4-point cubic (Catmull-Rom) interpolation,
+// error falling as the fourth power of the size, so a
+// small table (257 points) does as well as a large
+// linear one
+struct Cubic {
+  template<typename T>
+  static T wave(const Lookup<T> &t, unsigned int ph) {
+    unsigned int ndx = ph >> t.lobits;
+    T x = t.nfac*(ph & t.lomask);
+    T p0 = t.tab[(ndx - 1) & t.mask], p1 = t.tab[ndx],
+      p2 = t.tab[ndx+1], p3 = t.tab[(ndx + 2) & t.mask];
+    return p1 + (T) .5*x*(p2 - p0 + x*(2*p0 - 5*p1 + 4*p2 - p3 +
+                                       x*(3*(p1 - p2) + p3 - p0)));
+  }
+#if defined(__AVX2__)
+  static __m256d wave4(const Lookup<double> &t, __m128i ph) {
+    const __m128i one = _mm_set1_epi32(1), mask = _mm_set1_epi32((int) t.mask);
+    __m128i ndx = _mm_srli_epi32(ph,(int) t.lobits);
+    __m256d x = _mm256_mul_pd(_mm256_set1_pd(t.nfac),
+                              _mm256_cvtepi32_pd(_mm_and_si128(ph,
+                                         _mm_set1_epi32((int) t.lomask))));
+    __m256d p0 = gather4(t.tab,_mm_and_si128(_mm_sub_epi32(ndx,one),mask));
+    __m256d p1 = gather4(t.tab,ndx);
+    __m256d p2 = gather4(t.tab,_mm_add_epi32(ndx,one));
+    __m256d p3 = gather4(t.tab,_mm_and_si128(
+                           _mm_add_epi32(ndx,_mm_add_epi32(one,one)),mask));
+    __m256d c3 = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(
+                                               _mm256_set1_pd(3),
+                                               _mm256_sub_pd(p1,p2)),p3),p0);
+    __m256d c2 = _mm256_sub_pd(_mm256_add_pd(_mm256_sub_pd(
+                                               _mm256_add_pd(p0,p0),
+                                               _mm256_mul_pd(
+                                                 _mm256_set1_pd(5),p1)),
+                                             _mm256_mul_pd(
+                                               _mm256_set1_pd(4),p2)),p3);
+    __m256d c1 = _mm256_sub_pd(p2,p0);
+    __m256d r = _mm256_add_pd(c2,_mm256_mul_pd(x,c3));
+    r = _mm256_add_pd(c1,_mm256_mul_pd(x,r));
+    return _mm256_add_pd(p1,_mm256_mul_pd(_mm256_mul_pd(
+                                            _mm256_set1_pd(.5),x),r));
+  }
+  static __m256 wave8(const Lookup<float> &t, __m256i ph) {
+    const __m256i one = _mm256_set1_epi32(1),
+      mask = _mm256_set1_epi32((int) t.mask);
+    __m256i ndx = _mm256_srli_epi32(ph,(int) t.lobits);
+    __m256 x = _mm256_mul_ps(_mm256_set1_ps(t.nfac),
+                             _mm256_cvtepi32_ps(_mm256_and_si256(ph,
+                                        _mm256_set1_epi32((int) t.lomask))));
+    __m256 p0 = gather8(t.tab,_mm256_and_si256(
+                          _mm256_sub_epi32(ndx,one),mask));
+    __m256 p1 = gather8(t.tab,ndx);
+    __m256 p2 = gather8(t.tab,_mm256_add_epi32(ndx,one));
+    __m256 p3 = gather8(t.tab,_mm256_and_si256(
+                          _mm256_add_epi32(ndx,_mm256_add_epi32(one,one)),
+                          mask));
+    __m256 c3 = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(
+                                              _mm256_set1_ps(3),
+                                              _mm256_sub_ps(p1,p2)),p3),p0);
+    __m256 c2 = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(
+                                              _mm256_add_ps(p0,p0),
+                                              _mm256_mul_ps(
+                                                _mm256_set1_ps(5),p1)),
+                                            _mm256_mul_ps(
+                                              _mm256_set1_ps(4),p2)),p3);
+    __m256 c1 = _mm256_sub_ps(p2,p0);
+    __m256 r = _mm256_add_ps(c2,_mm256_mul_ps(x,c3));
+    r = _mm256_add_ps(c1,_mm256_mul_ps(x,r));
+    return _mm256_add_ps(p1,_mm256_mul_ps(_mm256_mul_ps(
+                                            _mm256_set1_ps(.5f),x),r));
+  }
+#endif
+};
+
+// no table: cos(2pi u), u = |ph| as a signed fraction of
+// a cycle, is sin(2pi v) for v = 1/4 - u in [-1/4,1/4],
+// an odd degree-9 minimax polynomial there (|err| < 3.4e-9
+// in double); no branches and no memory reads
+struct Minimax {
+  static constexpr double c1 = 6.283185160091178, c3 = -41.34165503105264,
+    c5 = 81.60100403084964, c7 = -76.54978110969483,
+    c9 = 39.53669631142906;
+  template<typename T>
+  static T wave(const Lookup<T> &, unsigned int ph) {
+    T v = (T) .25 - std::fabs((T) (int) ph*(T) (1/4294967296.));
+    T v2 = v*v;
+    return v*((T) c1 + v2*((T) c3 + v2*((T) c5 + v2*((T) c7 +
+                                                      v2*(T) c9))));
+  }
+#if defined(__AVX2__)
+  static __m256d wave4(const Lookup<double> &, __m128i ph) {
+    __m256d u = _mm256_mul_pd(_mm256_cvtepi32_pd(ph),
+                              _mm256_set1_pd(1/4294967296.));
+    // clear the sign bit for |u|
+    u = _mm256_andnot_pd(_mm256_set1_pd(-0.),u);
+    __m256d v = _mm256_sub_pd(_mm256_set1_pd(.25),u), v2 = _mm256_mul_pd(v,v);
+    __m256d r = _mm256_add_pd(_mm256_set1_pd(c7),
+                              _mm256_mul_pd(v2,_mm256_set1_pd(c9)));
+    r = _mm256_add_pd(_mm256_set1_pd(c5),_mm256_mul_pd(v2,r));
+    r = _mm256_add_pd(_mm256_set1_pd(c3),_mm256_mul_pd(v2,r));
+    r = _mm256_add_pd(_mm256_set1_pd(c1),_mm256_mul_pd(v2,r));
+    return _mm256_mul_pd(v,r);
+  }
+  static __m256 wave8(const Lookup<float> &, __m256i ph) {
+    __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(ph),
+                             _mm256_set1_ps((float) (1/4294967296.)));
+    u = _mm256_andnot_ps(_mm256_set1_ps(-0.f),u);
+    __m256 v = _mm256_sub_ps(_mm256_set1_ps(.25f),u), v2 = _mm256_mul_ps(v,v);
+    __m256 r = _mm256_add_ps(_mm256_set1_ps((float) c7),
+                             _mm256_mul_ps(v2,_mm256_set1_ps((float) c9)));
+    r = _mm256_add_ps(_mm256_set1_ps((float) c5),_mm256_mul_ps(v2,r));
+    r = _mm256_add_ps(_mm256_set1_ps((float) c3),_mm256_mul_ps(v2,r));
+    r = _mm256_add_ps(_mm256_set1_ps((float) c1),_mm256_mul_ps(v2,r));
+    return _mm256_mul_ps(v,r);
+  }
+#endif
+};
+
+#endif
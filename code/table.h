@@ -0,0 +1,223 @@
+#ifndef TABLE_H
+#define TABLE_H
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum Wave { COS, SIN };
+
+// constexpr series on |x| <= pi/4
+constexpr double ccos(double x) {
+  double x2 = x*x, t = 1, s = 1;
+  for(int k = 1; k < 12; k++) {
+    t *= -x2/((2*k-1)*(2*k));
+    s += t;
+  }
+  return s;
+}
+
+constexpr double csin(double x) {
+  double x2 = x*x, t = x, s = x;
+  for(int k = 1; k < 12; k++) {
+    t *= -x2/((2*k)*(2*k+1));
+    s += t;
+  }
+  return s;
+}
+
+/**
+   constexpr waveform at 2pi*n/m, with exact integer
+   reduction to the first octant (angle units of 1/8m)
+*/
+constexpr double wave2pi(std::size_t n, std::size_t m, Wave w) {
+  const double pi = 3.14159265358979323846;
+  std::size_t p = 8*m, a = (8*(n % m) + (w == SIN ? 6*m : 0)) % p;
+  double sgn = 1;
+  if(a > 4*m) a = p - a;
+  if(a > 2*m) {
+    a = 4*m - a;
+    sgn = -1;
+  }
+  return a > m ? sgn*csin(pi*(2*m - a)/(4*m)) : sgn*ccos(pi*a/(4*m));
+}
+
+/**
+   Compile-time table template class
+   takes sample type, size and waveform;
+   data is computed by the compiler and lives in .rodata
+*/
+template<typename S, std::size_t L, Wave W>
+struct ConstTable {
+  static constexpr std::array<S,L> make() {
+    std::array<S,L> t{};
+    for(std::size_t n = 0; n < L; n++)
+      t[n] = (S) wave2pi(n, L-1, W);
+    return t;
+  }
+  alignas(64) static constexpr std::array<S,L> data = make();
+};
+
+// compile-time table sizes are 2^cbits + 1, cbits in [cmin, cmax]
+const std::size_t cmin = 8, cmax = 12;
+
+/**
+   Table file header, followed by the table data at
+   offset 64 (see mktable.cpp)
+*/
+struct TableHeader {
+  char magic[8];
+  uint64_t size;
+  uint32_t bytes;
+  uint32_t wave;
+  char pad[40];
+};
+
+/**
+   Wave table template class
+   takes sample type.
+   Read-only, 64-byte aligned table of one period
+   plus a guard point (size 2^n + 1 for the Op lookup).
+   Data is either computed, compiled in, or mapped from
+   a precomputed file.
+*/
+template<typename S>
+class Table {
+  const S *mem;
+  std::size_t len;
+  void *map;
+  std::size_t maplen;
+  bool own;
+
+public:
+  /**
+     std::size_t size: table size
+     Wave w: waveform
+  */
+  Table(std::size_t size, Wave w) :
+    mem(nullptr), len(size), map(nullptr), maplen(0), own(true) {
+    std::size_t bytes = (len*sizeof(S) + 63) & ~(std::size_t) 63;
+    S *t = (S *) std::aligned_alloc(64, bytes);
+    if(!t) throw std::bad_alloc();
+    const double twopi = 2*M_PI;
+    for(std::size_t n = 0; n < len; n++)
+      t[n] = (S) (w == SIN ? std::sin(twopi/(len-1)*n) :
+                  std::cos(twopi/(len-1)*n));
+    mem = t;
+  }
+
+  /**
+     const S *data: static table data
+     std::size_t size: table size
+  */
+  Table(const S *data, std::size_t size) :
+    mem(data), len(size), map(nullptr), maplen(0), own(false) { };
+
+  /**
+     const std::string &path: table file
+     std::size_t size: expected table size
+     Wave w: expected waveform
+     leaves size() == 0 if the file does not match
+  */
+  Table(const std::string &path, std::size_t size, Wave w) :
+    mem(nullptr), len(0), map(nullptr), maplen(0), own(false) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    struct stat st;
+    std::size_t need = sizeof(TableHeader) + size*sizeof(S);
+    if(fstat(fd, &st) == 0 && (std::size_t) st.st_size >= need) {
+      void *p = mmap(nullptr, need, PROT_READ, MAP_SHARED, fd, 0);
+      if(p != MAP_FAILED) {
+        const TableHeader *h = (const TableHeader *) p;
+        if(std::memcmp(h->magic, "FMTABLE", 8) == 0 &&
+           h->size == size && h->bytes == sizeof(S) &&
+           h->wave == (uint32_t) w) {
+          map = p;
+          maplen = need;
+          len = size;
+          mem = (const S *) ((const char *) p + sizeof(TableHeader));
+        } else munmap(p, need);
+      }
+    }
+    close(fd);
+  }
+
+  ~Table() {
+    if(map) munmap(map, maplen);
+    else if(own) std::free((void *) mem);
+  }
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+
+  const S &operator[](std::size_t n) const { return mem[n]; }
+  const S *data() const { return mem; }
+  std::size_t size() const { return len; }
+  bool mapped() const { return map != nullptr; }
+  bool compiled() const { return !own && !map; }
+};
+
+/**
+   returns the table file name for (size, precision, waveform)
+*/
+template<typename S>
+std::string table_file(std::size_t size, Wave w) {
+  return std::string(w == SIN ? "sin-" : "cos-") +
+    std::to_string(size) + (sizeof(S) == 4 ? "-f32" : "-f64") + ".tab";
+}
+
+template<typename S, Wave W, std::size_t... B>
+const S *const_table(std::size_t size, std::index_sequence<B...>) {
+  const S *t = nullptr;
+  ((size == (1ul << (cmin+B)) + 1 ?
+    (t = ConstTable<S,(1ul << (cmin+B)) + 1,W>::data.data()) : t), ...);
+  return t;
+}
+
+/**
+   returns the process-wide table for (size, precision,
+   waveform). Compiled-in tables (2^8+1 to 2^12+1 points)
+   are used directly; larger ones are mapped from
+   $FM_TABLES/<table_file> if present, or else computed
+   on first request. Tables are reference-counted and
+   released when no longer used.
+*/
+template<typename S>
+std::shared_ptr<const Table<S>> table(std::size_t size = 1025,
+                                      Wave w = COS) {
+  static std::mutex mtx;
+  static std::map<std::pair<std::size_t,int>,
+                  std::weak_ptr<const Table<S>>> tables;
+  std::lock_guard<std::mutex> lock(mtx);
+  auto &entry = tables[{size, (int) w}];
+  auto t = entry.lock();
+  if(!t) {
+    auto seq = std::make_index_sequence<cmax - cmin + 1>();
+    const S *c = w == SIN ? const_table<S,SIN>(size, seq) :
+      const_table<S,COS>(size, seq);
+    if(c) t = std::make_shared<const Table<S>>(c, size);
+    else if(const char *dir = std::getenv("FM_TABLES")) {
+      t = std::make_shared<const Table<S>>(std::string(dir) + "/" +
+                                           table_file<S>(size, w),
+                                           size, w);
+      if(t->size() == 0) t = nullptr;
+    }
+    if(!t) t = std::make_shared<const Table<S>>(size, w);
+    entry = t;
+  }
+  return t;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TICKS_H
+#define TICKS_H
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+   returns the time-stamp counter (reference cycles),
+   or 0 where there is none
+*/
+inline unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+#endif
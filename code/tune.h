@@ -0,0 +1,234 @@
+#ifndef TUNE_H
+#define TUNE_H
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "op.h"
+
+/**
+   Op configurations: wave evaluator (sine.h), table
+   size and precision (samples and table)
+*/
+enum Eval { TRUNCATE, LINEAR, CUBIC, COSINE, MINIMAX };
+
+inline const char *eval_name(int e) {
+  static const char *names[] = {"trunc", "linear", "cubic", "cos", "minimax"};
+  return e >= TRUNCATE && e <= MINIMAX ? names[e] : "?";
+}
+
+// evaluators that read the table
+inline bool eval_table(int e) { return e <= CUBIC; }
+
+/**
+   calls f(s, w) with a value s of the configuration's
+   sample type (float or double) and its evaluator
+   policy w, so f can instantiate engines on their types
+*/
+template<typename F>
+void dispatch(int wave, bool dbl, F &&f) {
+  auto pick = [&](auto s) {
+    switch(wave) {
+    case TRUNCATE: f(s, Truncate()); break;
+    case CUBIC: f(s, Cubic()); break;
+    case COSINE: f(s, Cosine()); break;
+    case MINIMAX: f(s, Minimax()); break;
+    default: f(s, Linear());
+    }
+  };
+  if(dbl) pick(0.);
+  else pick(0.f);
+}
+
+/**
+   returns the size of the level 1 (data) to 3 cache in
+   bytes, 0 if unknown
+*/
+inline std::size_t cache_size(int level) {
+  long s = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+  s = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE :
+              level == 2 ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+#endif
+  return s > 0 ? (std::size_t) s : 0;
+}
+
+/**
+   returns the smallest cache level holding bytes,
+   0 if none (or unknown)
+*/
+inline int cache_level(std::size_t bytes) {
+  for(int l = 1; l <= 3; l++)
+    if(bytes <= cache_size(l)) return l;
+  return 0;
+}
+
+/**
+   Tuned configuration, with its measured cost and error
+*/
+struct Tuning {
+  int wave;          // Eval
+  bool dbl;          // double samples and table (reference), else float
+  std::size_t tab;   // table size (2^k + 1)
+  double ns;         // per sample, Op::process() (0: not measured)
+  double err;        // largest error (dB re full scale)
+
+  // table footprint (bytes)
+  std::size_t bytes() const {
+    return eval_table(wave) ? tab*(dbl ? sizeof(double) : sizeof(float)) : 0;
+  }
+
+  /**
+     writes the configuration to path as key/value lines;
+     returns false on failure
+  */
+  bool save(const char *path) const {
+    std::FILE *fp = std::fopen(path, "w");
+    if(!fp) return false;
+    std::fprintf(fp, "# fmtune, %s\nwave %s\nsample %s\ntable %zu\n"
+                 "ns %.3f\nerr %.1f\n", __VERSION__, eval_name(wave),
+                 dbl ? "double" : "float", tab, ns, err);
+    return std::fclose(fp) == 0;
+  }
+
+  /**
+     reads a configuration written by save() into t;
+     returns false (t unchanged) if path cannot be read
+  */
+  static bool load(const char *path, Tuning &t) {
+    std::FILE *fp = std::fopen(path, "r");
+    if(!fp) return false;
+    Tuning r = t;
+    char key[32], val[32];
+    while(std::fscanf(fp, "%31s %31s", key, val) == 2) {
+      if(key[0] == '#') {
+        int c;
+        while((c = std::fgetc(fp)) != '\n' && c != EOF);
+      } else if(std::strcmp(key, "wave") == 0) {
+        for(int e = TRUNCATE; e <= MINIMAX; e++)
+          if(std::strcmp(val, eval_name(e)) == 0) r.wave = e;
+      } else if(std::strcmp(key, "sample") == 0)
+        r.dbl = std::strcmp(val, "double") == 0;
+      else if(std::strcmp(key, "table") == 0)
+        r.tab = std::strtoul(val, nullptr, 10);
+      else if(std::strcmp(key, "ns") == 0) r.ns = std::atof(val);
+      else if(std::strcmp(key, "err") == 0) r.err = std::atof(val);
+    }
+    std::fclose(fp);
+    // table sizes are 2^k + 1
+    if(r.tab < 3 || ((r.tab - 1) & (r.tab - 2))) r.tab = 1025;
+    t = r;
+    return true;
+  }
+};
+
+/**
+   renders secs of a frequency-modulated operator (index
+   8, so the phase sweeps the table unevenly) with Op<S,W>
+   on a table of tab points: returns the cost (best of
+   3 runs) and the largest error against the cosine of
+   the operator's own phase, so only the wave evaluation
+   and the precision are measured
+*/
+template<typename S, typename W>
+Tuning probe(std::size_t tab, double secs, unsigned int sr = 44100) {
+  const std::size_t vs = 64, len = ((std::size_t) (secs*sr)/vs + 1)*vs;
+  const S fac = (S) (4294967296./sr);  // as Op<S,W>
+  const S fr = 440;
+  std::vector<S> fm(len), y(len);
+  for(std::size_t n = 0; n < len; n++)
+    fm[n] = (S) (8*fr*std::cos(2*M_PI*fr*1.5*n/sr));
+  auto t = table<S>(tab);
+  double best = 1e300;
+  for(int r = 0; r < 3; r++) {
+    Op<S,W> op(sr, vs, t);
+    auto t0 = std::chrono::steady_clock::now();
+    for(std::size_t n = 0; n < len; n += vs)
+      op.process(y.data() + n, vs, 1, fr, fm.data() + n);
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double,std::nano>(t1 -
+                                                                  t0).count());
+  }
+  unsigned int ph = 0;
+  double err = 0;
+  for(std::size_t n = 0; n < len; n++) {
+    err = std::max(err, std::fabs(y[n] - std::cos(ph*(2*M_PI/4294967296.))));
+    ph += (int) (Op<S,W>::freq(fr, 0, 0, fm[n])*fac);
+  }
+  int wave = std::is_same<W,Truncate>::value ? TRUNCATE :
+    std::is_same<W,Cubic>::value ? CUBIC :
+    std::is_same<W,Cosine>::value ? COSINE :
+    std::is_same<W,Minimax>::value ? MINIMAX : LINEAR;
+  return {wave, std::is_same<S,double>::value, tab, best/len,
+          20*std::log10(err + 1e-30)};
+}
+
+/**
+   measures the candidate configurations on this host:
+   the table evaluators at sizes 2^6 + 1 up to four times
+   the level 2 cache (2^22 + 1 at most), the table-free
+   ones, each in float and double. Returns the cheapest
+   with error under -db dB, preferring the smaller table
+   on near ties (the most accurate if none is under),
+   and all the measurements in res if given.
+   double secs: audio rendered per measurement
+*/
+inline Tuning autotune(double db = 120, double secs = .1,
+                       std::vector<Tuning> *res = nullptr) {
+  std::size_t l2 = cache_size(2), top = l2 ? 4*l2 : 1 << 19;
+  std::vector<Tuning> all;
+  for(int e = TRUNCATE; e <= MINIMAX; e++)
+    for(bool dbl : {false, true})
+      for(std::size_t k = 6; k <= 22; k++) {
+        std::size_t tab = eval_table(e) ? ((std::size_t) 1 << k) + 1 : 1025;
+        if(eval_table(e) && tab*(dbl ? sizeof(double) : sizeof(float)) > top)
+          break;
+        dispatch(e, dbl, [&](auto s, auto w) {
+            all.push_back(probe<decltype(s),decltype(w)>(tab, secs));
+          });
+        if(!eval_table(e)) break;
+      }
+  const Tuning *best = nullptr, *close = &all[0];
+  for(auto &t : all) {
+    if(t.err <= -db && (!best || t.ns < best->ns)) best = &t;
+    if(t.err < close->err) close = &t;
+  }
+  // within 5% of the cheapest counts as a tie (timing
+  // noise): then the smallest cache footprint wins
+  if(best) {
+    double ns = best->ns;
+    for(auto &t : all)
+      if(t.err <= -db && t.ns <= ns*1.05 && t.bytes() < best->bytes())
+        best = &t;
+  }
+  Tuning r = best ? *best : *close;
+  if(res) *res = all;
+  return r;
+}
+
+/**
+   returns the process-wide configuration, read from the
+   file $FM_TUNING names (written by fmtune); the defaults
+   (linear, float, 1025 points) without $FM_TUNING or if
+   the file cannot be read. Never tunes: call it from a
+   program's startup, not from engine constructors.
+*/
+inline const Tuning &tuning() {
+  static const Tuning t = [] {
+    Tuning r{LINEAR, false, 1025, 0, 0};
+    if(const char *path = std::getenv("FM_TUNING"))
+      if(!Tuning::load(path, r))
+        std::fprintf(stderr, "cannot read %s, using defaults "
+                     "(run fmtune 120 %s to create it)\n", path, path);
+    return r;
+  }();
+  return t;
+}
+
+#endif
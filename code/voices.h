@@ -0,0 +1,269 @@
+#ifndef VOICES_H
+#define VOICES_H
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <tuple>
+#include <chrono>
+#include "param.h"
+
+/**
+   Voice manager statistics (render thread)
+*/
+struct VoiceStats {
+  std::size_t active;    // voices sounding after the last render
+  std::size_t peak;      // most voices sounding at once
+  std::size_t stolen;    // notes that took a sounding voice
+  std::size_t rendered;  // voice chunks rendered
+  std::size_t skipped;   // voice chunks skipped (silent)
+  double ns;             // time rendering voices (ns)
+
+  // average render time per voice chunk
+  double per_voice() const { return rendered ? ns/rendered : 0; }
+};
+
+/**
+   Polyphonic voice manager template class
+   takes the voice engine (fm_v7 StackedFM) and the pool
+   size P. Voices are built once, up front; on() takes a free voice or steals one,
+   released voices before held ones (the quietest or
+   the oldest of them), fades it out over a few
+   milliseconds and only then restarts it with the new
+   note; off() releases it. Each voice has a linear attack/release
+   amplitude envelope, rendered as a ramp; voices whose
+   envelope has reached zero are not rendered at all.
+   Modulator frequencies are ratios of the note
+   frequency.
+*/
+template<typename E, std::size_t P>
+class Voices {
+public:
+  using S = typename E::sample;
+  static constexpr std::size_t N = E::order();
+  enum Steal { QUIETEST, OLDEST };
+
+  /**
+     Voice patch: modulator ratios fm[i]/f and indices,
+     attack and release times (s)
+  */
+  struct Patch {
+    std::array<S,N> ratio;
+    std::array<S,N> z;
+    double attack, release;
+  };
+
+private:
+  struct Voice {
+    E fm;
+    int id;               // note id, -1 if free
+    bool held;            // note on, not yet released
+    S freq, gain;
+    S env;                // envelope level, 0 .. 1
+    std::uint64_t start;  // note-on count, for stealing
+    int next;             // note waiting for the fade out, -1 if none
+    bool nheld;
+    S nfreq, ngain;
+  };
+
+  std::vector<Voice> pool;
+  std::vector<float> tmp;
+  std::vector<std::size_t> live;  // sounding voices (threaded render)
+  std::vector<double> cost, took;
+  Patch patch;
+  Steal policy;
+  std::uint64_t count;
+  S up, down, cut;      // envelope rates per frame (cut: stolen voices)
+  VoiceStats st;
+
+  static S rate(double secs, double sr) {
+    return secs > 0 ? (S) (1/(secs*sr)) : (S) 1;
+  }
+
+  // voice to (re)start for a new note: a free one, else
+  // released voices before held ones, the oldest or the
+  // quietest (released: current level; held: the level
+  // the attack goes to, so a note just started is not
+  // taken for a quiet one); voices already fading out
+  // for a stolen note last
+  Voice &take() {
+    for(auto &v : pool)
+      if(v.id < 0) return v;
+    st.stolen++;
+    auto rank = [&](const Voice &v) {
+      return std::make_tuple(v.next >= 0, v.held,
+                             policy == OLDEST ? (double) v.start :
+                             (double) (v.held ? v.gain : v.env*v.gain));
+    };
+    return *std::min_element(pool.begin(), pool.end(),
+                             [&](const Voice &a, const Voice &b) {
+                               return rank(a) < rank(b);
+                             });
+  }
+
+  // (re)starts v with its waiting note
+  void begin(Voice &v) {
+    std::array<S,N> fm;
+    for(std::size_t i = 0; i < N; i++) fm[i] = v.nfreq*patch.ratio[i];
+    v.fm.start(fm, patch.z);
+    v.id = v.next;
+    v.held = v.nheld;
+    v.freq = v.nfreq;
+    v.gain = v.ngain;
+    v.env = 0;
+    v.next = -1;
+  }
+
+  // renders one voice over n frames into buf and mixes
+  // it into dst
+  void voice(Voice &v, float *dst, std::size_t n, float *buf) {
+    S e = v.held ? std::min(v.env + up*n, (S) 1) :
+      std::max(v.env - (v.next >= 0 ? cut : down)*n, (S) 0);
+    std::array<S,N> fm;
+    for(std::size_t i = 0; i < N; i++) fm[i] = v.freq*patch.ratio[i];
+    if(e == v.env)
+      v.fm.process(buf, n, v.gain*e, v.freq, fm, patch.z);
+    else
+      v.fm.process(buf, n, line(v.gain*v.env, v.gain*e), v.freq,
+                   fm, patch.z);
+    for(std::size_t j = 0; j < n; j++) dst[j] += buf[j];
+    v.env = e;
+    if(e == 0 && !v.held) {
+      if(v.next >= 0 && v.nheld) begin(v);
+      else v.id = -1;
+    }
+  }
+
+public:
+  /**
+     unsigned int fs: sampling rate
+     const Patch &p: voice patch
+     std::size_t vsize: voice render block size
+     Steal s: stealing policy
+     double fade: fade out of stolen voices (s)
+     args: engine constructor arguments between the
+     sampling rate and the block size (StackedFM: the
+     oversampling factor)
+  */
+  template<typename... Args>
+  Voices(unsigned int fs, const Patch &p,
+         std::size_t vsize, Steal s, double fade, Args&&... args) :
+    tmp(vsize), live(P), cost(P), took(P), patch(p), policy(s), count(0),
+    up(rate(p.attack, fs)), down(rate(p.release, fs)), cut(rate(fade, fs)),
+    st() {
+    pool.reserve(P);
+    for(std::size_t n = 0; n < P; n++)
+      pool.push_back({E(fs, args..., vsize), -1, false, 0, 0, 0, 0,
+                      -1, false, 0, 0});
+  }
+
+  /**
+     starts note id at frequency f and amplitude a; on a
+     stolen voice, once its fade out ends (a note waiting
+     there already is dropped)
+  */
+  void on(int id, S f, S a) {
+    Voice &v = take();
+    v.next = id;
+    v.nheld = true;
+    v.nfreq = f;
+    v.ngain = a;
+    v.start = count++;
+    // free or still silent: no fade needed
+    if(v.id < 0 || v.env == 0) begin(v);
+    else v.held = false;
+  }
+
+  /**
+     releases note id: the release starts from the current
+     envelope level, so a note not yet sounding frees its
+     voice at once, and one still waiting for a fade out
+     is not started
+  */
+  void off(int id) {
+    for(auto &v : pool) {
+      if(v.id == id && v.held) {
+        v.held = false;
+        if(v.env == 0) v.id = -1;
+      }
+      if(v.next == id) v.nheld = false;
+    }
+  }
+
+  /**
+     renders nframes of the mix into dst (overwritten)
+  */
+  void process(float *dst, std::size_t nframes) {
+    std::fill(dst, dst + nframes, 0.f);
+    for(std::size_t n = 0; n < nframes; n += tmp.size()) {
+      std::size_t len = std::min(tmp.size(), nframes - n);
+      std::size_t act = 0;
+      for(auto &v : pool) {
+        if(v.id < 0) {
+          st.skipped++;
+          continue;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        voice(v, dst + n, len, tmp.data());
+        auto t1 = std::chrono::steady_clock::now();
+        st.ns += std::chrono::duration<double,std::nano>(t1 - t0).count();
+        st.rendered++;
+        act += v.id >= 0;
+      }
+      st.active = act;
+      st.peak = std::max(st.peak, act);
+    }
+  }
+
+  /**
+     renders nframes of the mix into dst (overwritten),
+     sharing each chunk's sounding voices among a worker
+     pool (workers.h; vsize frames or more per worker),
+     weighted by their oversampling factor
+  */
+  template<typename W>
+  void process(float *dst, std::size_t nframes, W &workers) {
+    for(std::size_t n = 0; n < nframes; n += tmp.size()) {
+      std::size_t len = std::min(tmp.size(), nframes - n), cnt = 0;
+      for(std::size_t i = 0; i < P; i++) {
+        if(pool[i].id < 0) {
+          st.skipped++;
+          continue;
+        }
+        cost[cnt] = (double) pool[i].fm.factor();
+        live[cnt++] = i;
+      }
+      workers.run(cnt, cost.data(), [&](std::size_t k, std::size_t w) {
+          auto t0 = std::chrono::steady_clock::now();
+          voice(pool[live[k]], workers.acc(w), len, workers.tmp(w));
+          auto t1 = std::chrono::steady_clock::now();
+          took[k] = std::chrono::duration<double,std::nano>(t1 - t0).count();
+        });
+      workers.reduce(dst + n, len);
+      std::size_t act = 0;
+      for(std::size_t k = 0; k < cnt; k++) {
+        st.ns += took[k];
+        act += pool[live[k]].id >= 0;
+      }
+      st.rendered += cnt;
+      st.active = act;
+      st.peak = std::max(st.peak, act);
+    }
+  }
+
+  /**
+     returns the voices sounding
+  */
+  std::size_t active() const { return st.active; }
+
+  /**
+     returns the statistics since construction or reset()
+  */
+  const VoiceStats &stats() const { return st; }
+  void reset() { st = VoiceStats(); }
+
+  static constexpr std::size_t size() { return P; }
+};
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+/**
+   Worker pool statistics
+*/
+struct WorkerStats {
+  std::size_t blocks;        // blocks run
+  std::size_t steals;        // tasks taken from another worker
+  double wall;               // block wall time, sum (ns)
+  double last;               // last block wall time (ns)
+  double worst;              // longest block wall time (ns)
+  std::vector<double> busy;  // per worker, time in tasks (ns)
+
+  // fraction of the block time worker w spent working
+  double utilisation(std::size_t w) const {
+    return wall > 0 ? busy[w]/wall : 0;
+  }
+};
+
+/**
+   Work-stealing worker pool class
+   runs a block's tasks on a fixed set of threads (the
+   caller is worker 0). Tasks are dealt to per-worker
+   deques by estimated cost (largest first, to the least
+   loaded), each worker pops from the back of its own
+   and steals from the front of the others' when it runs
+   out. Every worker has a private accumulator that the
+   tasks mix into, summed by reduce() at the end of the
+   block. No allocation once constructed; idle workers
+   spin (yielding) on the block counter for a while, then
+   sleep on a condition variable, which run() only locks
+   to wake them. The caller waits for the block's end the
+   same way, woken by the last worker to finish.
+*/
+class Workers {
+  using clock = std::chrono::steady_clock;
+
+  // deque over a block's task list: filled before the
+  // block starts, then popped by the owner (bottom) and
+  // stolen by the others (top), Chase-Lev style
+  struct Deque {
+    std::vector<std::size_t> task;
+    alignas(64) std::atomic<long> top;
+    alignas(64) std::atomic<long> bottom;
+    std::vector<float> acc;
+    std::vector<float> tmp;
+    double load;
+    double busy;
+    std::size_t steals;
+  };
+
+  std::vector<Deque> dq;
+  std::vector<std::thread> threads;
+  std::vector<std::size_t> order;
+  alignas(64) std::atomic<std::size_t> gen;
+  alignas(64) std::atomic<std::size_t> done;
+  std::atomic<bool> quit;
+  std::atomic<std::size_t> parked;  // workers asleep (or going to)
+  std::atomic<bool> joining;        // caller asleep (or going to)
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::condition_variable fin;
+  clock::duration spin;
+  void (*call)(void *, std::size_t, std::size_t);
+  void *ctx;
+  WorkerStats st;
+
+  bool pop(Deque &d, std::size_t &x) {
+    long b = d.bottom.load(std::memory_order_relaxed) - 1;
+    d.bottom.store(b);
+    long t = d.top.load();
+    if(t > b) {
+      d.bottom.store(b + 1);
+      return false;
+    }
+    x = d.task[b];
+    if(t == b) {
+      // last task: race the thieves for it
+      bool won = d.top.compare_exchange_strong(t, t + 1);
+      d.bottom.store(b + 1);
+      return won;
+    }
+    return true;
+  }
+
+  bool steal(Deque &d, std::size_t &x) {
+    long t = d.top.load(), b = d.bottom.load();
+    if(t >= b) return false;
+    x = d.task[t];
+    return d.top.compare_exchange_strong(t, t + 1);
+  }
+
+  void work(std::size_t w) {
+    auto t0 = clock::now();
+    Deque &own = dq[w];
+    std::fill(own.acc.begin(), own.acc.end(), 0.f);
+    std::size_t x, n = dq.size();
+    for(;;) {
+      if(pop(own, x)) {
+        call(ctx, x, w);
+        continue;
+      }
+      bool got = false;
+      for(std::size_t k = 1; k < n && !got; k++) {
+        Deque &d = dq[(w + k) % n];
+        // retry a contended steal while the deque has work
+        while(d.top.load() < d.bottom.load())
+          if((got = steal(d, x))) break;
+      }
+      if(!got) break;
+      own.steals++;
+      call(ctx, x, w);
+    }
+    own.busy += std::chrono::duration<double,std::nano>(clock::now()
+                                                          - t0).count();
+  }
+
+  // waits for a block after seen: spins, then sleeps
+  std::size_t wait(std::size_t seen) {
+    std::size_t g;
+    auto t0 = clock::now();
+    while((g = gen.load(std::memory_order_acquire)) == seen)
+      if(clock::now() - t0 < spin) std::this_thread::yield();
+      else {
+        // counted before gen is read again, so wake()
+        // either sees the count or this sees the block
+        std::unique_lock<std::mutex> lock(mtx);
+        parked.fetch_add(1);
+        cv.wait(lock, [&] { return gen.load() != seen; });
+        parked.fetch_sub(1);
+      }
+    return g;
+  }
+
+  // starts a block (or the shutdown)
+  void wake() {
+    gen.fetch_add(1);
+    if(parked.load()) {
+      std::lock_guard<std::mutex> lock(mtx);
+      cv.notify_all();
+    }
+  }
+
+  // waits for the other workers to finish the block:
+  // spins, then sleeps until the last one wakes it
+  void join() {
+    auto t0 = clock::now();
+    auto all = [&] { return done.load() + 1 >= dq.size(); };
+    while(!all())
+      if(clock::now() - t0 < spin) std::this_thread::yield();
+      else {
+        // flagged before done is read again, so the last
+        // worker either sees the flag or this sees done
+        std::unique_lock<std::mutex> lock(mtx);
+        joining.store(true);
+        fin.wait(lock, all);
+        joining.store(false);
+      }
+  }
+
+  void loop(std::size_t w) {
+    std::size_t seen = 0;
+    for(;;) {
+      seen = wait(seen);
+      if(quit.load()) return;
+      work(w);
+      if(done.fetch_add(1) + 2 == dq.size() && joining.load()) {
+        std::lock_guard<std::mutex> lock(mtx);
+        fin.notify_one();
+      }
+    }
+  }
+
+public:
+  /**
+     std::size_t nthreads: workers, including the caller
+     std::size_t vsize: accumulator size (frames per block)
+     std::size_t tasks: most tasks in a block
+     double idle: time idle workers (and the caller, at
+     the end of a block) spin before they sleep (s);
+     sleeping saves the cores between bursts of blocks,
+     spinning the wake-up latency
+  */
+  Workers(std::size_t nthreads, std::size_t vsize, std::size_t tasks,
+          double idle = .002) :
+    dq(std::max(nthreads, (std::size_t) 1)), order(tasks), gen(0),
+    done(0), quit(false), parked(0), joining(false),
+    spin(std::chrono::duration_cast<clock::duration>(
+           std::chrono::duration<double>(idle))),
+    call(nullptr), ctx(nullptr), st() {
+    for(auto &d : dq) {
+      d.task.resize(tasks);
+      d.top = d.bottom = 0;
+      d.acc.resize(vsize);
+      d.tmp.resize(vsize);
+      d.busy = 0;
+      d.steals = 0;
+    }
+    st.busy.resize(dq.size());
+    for(std::size_t w = 1; w < dq.size(); w++)
+      threads.emplace_back([this, w] { loop(w); });
+  }
+
+  ~Workers() {
+    quit = true;
+    wake();
+    for(auto &t : threads) t.join();
+  }
+
+  Workers(const Workers &) = delete;
+  Workers &operator=(const Workers &) = delete;
+
+  /**
+     runs fn(task, worker) for task = 0 .. count-1 across
+     the workers and returns when all are done
+     const double *cost: estimated cost of each task
+  */
+  template<typename F>
+  void run(std::size_t count, const double *cost, F &&fn) {
+    auto t0 = clock::now();
+    count = std::min(count, order.size());
+    // largest first, each to the least loaded worker
+    for(std::size_t i = 0; i < count; i++) order[i] = i;
+    std::sort(order.begin(), order.begin() + count,
+              [cost](std::size_t a, std::size_t b) {
+                return cost[a] > cost[b];
+              });
+    for(auto &d : dq) {
+      d.top = 0;
+      d.bottom = 0;
+      d.load = 0;
+    }
+    for(std::size_t i = 0; i < count; i++) {
+      auto &d = *std::min_element(dq.begin(), dq.end(),
+                                  [](const Deque &a, const Deque &b) {
+                                    return a.load < b.load;
+                                  });
+      d.task[d.bottom.load(std::memory_order_relaxed)] = order[i];
+      d.bottom.store(d.bottom.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      d.load += cost[order[i]];
+    }
+    // owners pop from the back, so put the costly tasks
+    // there and leave the cheap ones for thieves
+    for(auto &d : dq)
+      std::reverse(d.task.begin(),
+                   d.task.begin() + d.bottom.load(std::memory_order_relaxed));
+    call = [](void *c, std::size_t x, std::size_t w) {
+      (*static_cast<std::remove_reference_t<F> *>(c))(x, w);
+    };
+    ctx = &fn;
+    done.store(0, std::memory_order_relaxed);
+    wake();
+    work(0);
+    join();
+    double t = std::chrono::duration<double,std::nano>(clock::now()
+                                                         - t0).count();
+    st.blocks++;
+    st.wall += t;
+    st.last = t;
+    st.worst = std::max(st.worst, t);
+  }
+
+  /**
+     returns worker w's accumulator and scratch buffers
+     (vsize frames), for tasks run by w
+  */
+  float *acc(std::size_t w) { return dq[w].acc.data(); }
+  float *tmp(std::size_t w) { return dq[w].tmp.data(); }
+
+  /**
+     sums the accumulators' first nframes into dst
+  */
+  void reduce(float *dst, std::size_t nframes) {
+    std::copy(dq[0].acc.begin(), dq[0].acc.begin() + nframes, dst);
+    for(std::size_t w = 1; w < dq.size(); w++) {
+      const float *a = dq[w].acc.data();
+      for(std::size_t n = 0; n < nframes; n++) dst[n] += a[n];
+    }
+  }
+
+  std::size_t size() const { return dq.size(); }
+
+  /**
+     returns the statistics (between blocks)
+  */
+  const WorkerStats &stats() {
+    st.steals = 0;
+    for(std::size_t w = 0; w < dq.size(); w++) {
+      st.busy[w] = dq[w].busy;
+      st.steals += dq[w].steals;
+    }
+    return st;
+  }
+};
+
+#endif